@@ -8,11 +8,12 @@
 
 /// my packages
 namespace ExpLib{
+    class SpatialHash;
     namespace Struct{
         template<typename T>
         struct pubStruct;
         template<typename T>
-        struct subStruct;
+        class LatestValue;
     }
 }
 namespace exploration_msgs{
@@ -66,14 +67,17 @@ class FrontierBasedExploration{
         // static parameters
         std::string FBE_PARAMETER_FILE_PATH;
         bool OUTPUT_FBE_PARAMETERS;
+        double FRONTIER_MAX_AGE; // これより古い (秒) 値は送り元が止まったとみなして使わない
+        double POSE_MAX_AGE;
 
         // variables
-        std::unique_ptr<ExStc::subStruct<exploration_msgs::FrontierArray>> frontier_;
-        std::unique_ptr<ExStc::subStruct<geometry_msgs::PoseStamped>> pose_;
-        std::unique_ptr<ExStc::subStruct<exploration_msgs::PointArray>> canceled_;
+        std::unique_ptr<ExStc::LatestValue<exploration_msgs::FrontierArray>> frontier_;
+        std::unique_ptr<ExStc::LatestValue<geometry_msgs::PoseStamped>> pose_;
+        std::unique_ptr<ExStc::LatestValue<exploration_msgs::PointArray>> canceled_;
         std::unique_ptr<ExStc::pubStruct<geometry_msgs::PointStamped>> goal_;
         std::unique_ptr<dynamic_reconfigure::Server<exploration::frontier_based_exploration_parameter_reconfigureConfig>> drs_;
         std::unique_ptr<geometry_msgs::Point> lastGoal_;
+        std::unique_ptr<ExpLib::SpatialHash> canceledHash_;
 
         // functions
         bool decideGoal(geometry_msgs::PointStamped& goal, const std::vector<exploration_msgs::Frontier>& frontiers, const geometry_msgs::PoseStamped& pose);
@@ -0,0 +1,80 @@
+#ifndef GOAL_ALLOCATION_H
+#define GOAL_ALLOCATION_H
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// 前方宣言
+
+/// my packages
+namespace ExpLib{
+    template <typename T>
+    class PathPlanning;
+    namespace Struct{
+        template<typename T>
+        class LatestValue;
+    }
+}
+namespace exploration_msgs{
+    template <class ContainerAllocator>
+    struct BranchArray_;
+    typedef ::exploration_msgs::BranchArray_<std::allocator<void>> BranchArray;
+    template <class ContainerAllocator>
+    struct FrontierArray_;
+    typedef ::exploration_msgs::FrontierArray_<std::allocator<void>> FrontierArray;
+    template <class ContainerAllocator>
+    struct RobotInfoArray_;
+    typedef ::exploration_msgs::RobotInfoArray_<std::allocator<void>> RobotInfoArray;
+}
+/// ros
+namespace navfn{
+    class NavfnROS;
+}
+namespace tf{
+    class TransformListener;
+}
+// 前方宣言ここまで
+
+// 全てのロボットの目標をまとめて割り当てる
+// ロボットと目標候補 (frontier と各ロボットの分岐) のコスト行列を一度だけ作り, 割り当て問題として解いた結果をロボットごとに publish する
+namespace ExStc = ExpLib::Struct;
+
+class GoalAllocation{
+    private:
+        // static parameters
+        double ALLOCATION_RATE;
+        double DISTANCE_WEIGHT;
+        double DIRECTION_WEIGHT;
+        double DUPLICATE_COEFF;
+        double ON_MAP_COEFF;
+        std::string BRANCH_TOPIC;
+        std::string ALLOCATED_GOAL_TOPIC;
+        double ROBOT_ARRAY_MAX_AGE; // これより古い (秒) 値は送り元が止まったとみなして使わない
+        double FRONTIER_MAX_AGE;
+        double BRANCH_MAX_AGE;
+
+        // struct
+        struct robotStruct;
+        struct targetStruct;
+
+        // variables
+        std::unique_ptr<ExStc::LatestValue<exploration_msgs::RobotInfoArray>> robotArray_;
+        std::unique_ptr<ExStc::LatestValue<exploration_msgs::FrontierArray>> frontier_;
+        std::unique_ptr<ExpLib::PathPlanning<navfn::NavfnROS>> pp_;
+        std::unique_ptr<tf::TransformListener> tfl_;
+        std::unique_ptr<std::unordered_map<std::string,robotStruct>> robots_;
+
+        // functions
+        void robotRegistration(const exploration_msgs::RobotInfoArray& ria);
+        void collectTargets(const exploration_msgs::FrontierArray& fa, std::vector<targetStruct>& targets);
+        bool allocate(void);
+        void loadParams(void);
+
+    public:
+        GoalAllocation();
+        ~GoalAllocation();
+        void mainLoop(void);
+};
+
+#endif // GOAL_ALLOCATION_H
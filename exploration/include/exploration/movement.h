@@ -9,11 +9,12 @@
 namespace ExpLib{
     template <typename T>
     class PathPlanning;
+    class ScanPreprocessor;
     namespace Struct{
         template<typename T>
         struct pubStruct;
         template<typename T>
-        struct subStruct;
+        class LatestValue;
     }
 }
 namespace exploration_msgs{
@@ -114,17 +115,19 @@ class Movement {
         std::string MOVEBASE_NAME;
         std::string MOVEMENT_PARAMETER_FILE_PATH;
         bool OUTPUT_MOVEMENT_PARAMETERS;
+        double POSE_MAX_AGE; // これより古い (秒) 姿勢は送り元が止まったとみなして使わない
 
         // variables
-        std::unique_ptr<ExStc::subStruct<sensor_msgs::LaserScan>> scan_;
-        std::unique_ptr<ExStc::subStruct<geometry_msgs::PoseStamped>> pose_;
-        std::unique_ptr<ExStc::subStruct<kobuki_msgs::BumperEvent>> bumper_;
-        std::unique_ptr<ExStc::subStruct<nav_msgs::OccupancyGrid>> gCostmap_;
+        std::unique_ptr<ExStc::LatestValue<sensor_msgs::LaserScan>> scan_;
+        std::unique_ptr<ExStc::LatestValue<geometry_msgs::PoseStamped>> pose_;
+        std::unique_ptr<ExStc::LatestValue<kobuki_msgs::BumperEvent>> bumper_;
+        std::unique_ptr<ExStc::LatestValue<nav_msgs::OccupancyGrid>> gCostmap_;
         std::unique_ptr<ExStc::pubStruct<geometry_msgs::Twist>> velocity_;
         std::unique_ptr<ExStc::pubStruct<geometry_msgs::PointStamped>> goal_;
         std::unique_ptr<ExStc::pubStruct<geometry_msgs::PointStamped>> road_;
         std::unique_ptr<ExStc::pubStruct<exploration_msgs::AvoidanceStatus>> avoStatus_;
         std::unique_ptr<ExpLib::PathPlanning<navfn::NavfnROS>> pp_;
+        std::unique_ptr<ExpLib::ScanPreprocessor> scanPre_;
         std::unique_ptr<dynamic_reconfigure::Server<exploration::movement_parameter_reconfigureConfig>> drs_;
         double previousOrientation_;
 
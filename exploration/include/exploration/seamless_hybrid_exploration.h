@@ -14,7 +14,7 @@ namespace ExpLib{
         template<typename T>
         struct pubStruct;
         template<typename T>
-        struct subStruct;
+        class LatestValue;
     }
 }
 namespace exploration_msgs{
@@ -22,6 +22,9 @@ namespace exploration_msgs{
     struct BranchArray_;
     typedef ::exploration_msgs::BranchArray_<std::allocator<void>> BranchArray;
     template <class ContainerAllocator>
+    struct Frontier_;
+    typedef ::exploration_msgs::Frontier_<std::allocator<void>> Frontier;
+    template <class ContainerAllocator>
     struct FrontierArray_;
     typedef ::exploration_msgs::FrontierArray_<std::allocator<void>> FrontierArray;
     template <class ContainerAllocator>
@@ -67,19 +70,29 @@ class SeamlessHybridExploration :public SensorBasedExploration{
         double DUPLICATE_COEFF;
         double ON_MAP_COEFF;
         double LAST_GOAL_WEIGHT;
+        bool USE_ALLOCATED_GOAL;
+        double ALLOCATED_GOAL_TIMEOUT;
+        bool AF_BRANCH_AND_BOUND;
+        double AF_APPROXIMATION_TOLERANCE;
 
         // static parameters
         std::string ROBOT_NAME;
         std::string SHE_PARAMETER_FILE_PATH;
         bool OUTPUT_SHE_PARAMETERS;
+        double ROBOT_ARRAY_MAX_AGE; // これより古い (秒) 値は送り元が止まったとみなして使わない
+        double FRONTIER_MAX_AGE;
 
         // struct
         struct maxValue;
         struct preCalcResult;
+        struct preCalcMatrix;
+        struct goalWorker;
+        struct dynamicParams;
 
         // variables
-        std::unique_ptr<ExStc::subStruct<exploration_msgs::RobotInfoArray>> robotArray_;
-        std::unique_ptr<ExStc::subStruct<exploration_msgs::FrontierArray>> frontier_;
+        std::unique_ptr<ExStc::LatestValue<exploration_msgs::RobotInfoArray>> robotArray_;
+        std::unique_ptr<ExStc::LatestValue<exploration_msgs::FrontierArray>> frontier_;
+        std::unique_ptr<ExStc::LatestValue<geometry_msgs::PointStamped>> allocatedGoal_;
         std::unique_ptr<ExpLib::PathPlanning<navfn::NavfnROS>> pp_;
         std::unique_ptr<dynamic_reconfigure::Server<exploration::seamless_hybrid_exploration_parameter_reconfigureConfig>> drs_;
         std::unique_ptr<exploration_msgs::BranchArray> ba_;
@@ -89,9 +102,15 @@ class SeamlessHybridExploration :public SensorBasedExploration{
         std::vector<preCalcResult> otherPreCalc_;
         std::unique_ptr<geometry_msgs::PoseStamped> ps_;
         std::unique_ptr<maxValue> mVal_;
+        std::unique_ptr<preCalcMatrix> pcm_;
+        std::unique_ptr<goalWorker> gw_;
+        std::unique_ptr<dynamicParams> sheParams_;
 
         // functions
         bool decideGoal(geometry_msgs::PointStamped& goal);
+        bool allocatedGoal(geometry_msgs::PointStamped& goal);
+        void setLastGoal(const geometry_msgs::Point& point);
+        geometry_msgs::Point branchAndBoundAF(const std::vector<exploration_msgs::Frontier>& frontiers, const geometry_msgs::PoseStamped& pose, const std::string& frame);
         // bool decideGoal(geometry_msgs::PointStamped& goal, const std::vector<ExStc::listStruct>& ls, const geometry_msgs::PoseStamped& pose);
         bool decideGoal(geometry_msgs::PointStamped& goal, const exploration_msgs::BranchArray& ls, const geometry_msgs::PoseStamped& pose);
         // bool filter(std::vector<ExStc::listStruct>& ls, exploration_msgs::FrontierArray& fa, exploration_msgs::RobotInfoArray& ria);
@@ -101,12 +120,18 @@ class SeamlessHybridExploration :public SensorBasedExploration{
         void loadParams(void);
         void dynamicParamsCB(exploration::seamless_hybrid_exploration_parameter_reconfigureConfig &cfg, uint32_t level);
         void outputParams(void);
+        void syncParams(void);
+        void goalWorkerLoop(double period);
 
     public:
         SeamlessHybridExploration();
         ~SeamlessHybridExploration();
+        bool getGoal(geometry_msgs::PointStamped& goal);
         bool forwardTargetDetection(void);
         bool getGoalAF(geometry_msgs::PointStamped& goal);
+        void startGoalThread(double period);
+        void stopGoalThread(void);
+        bool latestGoal(geometry_msgs::PointStamped& goal);
         void simBridge(std::vector<geometry_msgs::Pose>& r, std::vector<geometry_msgs::Point>& b, std::vector<geometry_msgs::Point>& f);
 };
 
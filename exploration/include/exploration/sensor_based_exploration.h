@@ -8,12 +8,13 @@
 
 /// my packages
 namespace ExpLib{
+    class SpatialHash;
     namespace Struct{
         struct listStruct;
         template<typename T>
         struct pubStruct;
         template<typename T>
-        struct subStruct;
+        class LatestValue;
     }
 }
 namespace exploration_msgs{
@@ -103,20 +104,33 @@ class SensorBasedExploration{
         // double DUPLICATE_TOLERANCE;
         // double LOG_CURRENT_TIME;//if 30 -> 30秒前までのログで重複検出
         // double NEWER_DUPLICATION_THRESHOLD;//最近通った場所の重複とみなす時間の上限,時間の仕様はLOG_NEWER_LIMITと同じ
+
+        // static parameters
+        double BRANCH_MAX_AGE; // これより古い (秒) 分岐と姿勢は送り元が止まったとみなして使わない
+        double POSE_MAX_AGE;
+
+        // struct
+        struct dynamicParams;
         
         // variables
-        std::unique_ptr<ExStc::subStruct<exploration_msgs::BranchArray>> branch_;
-        std::unique_ptr<ExStc::subStruct<geometry_msgs::PoseStamped>> pose_;
+        std::unique_ptr<ExStc::LatestValue<exploration_msgs::BranchArray>> branch_;
+        std::unique_ptr<ExStc::LatestValue<geometry_msgs::PoseStamped>> pose_;
         std::unique_ptr<ExStc::pubStruct<geometry_msgs::PointStamped>> goal_;
-        std::unique_ptr<ExStc::subStruct<exploration_msgs::PointArray>> canceled_;
+        std::unique_ptr<ExStc::LatestValue<exploration_msgs::PointArray>> canceled_;
         // std::unique_ptr<ExStc::subStruct<nav_msgs::OccupancyGrid>> map_;
         std::unique_ptr<dynamic_reconfigure::Server<exploration::sensor_based_exploration_parameter_reconfigureConfig>> drs_;
         std::unique_ptr<geometry_msgs::Point> lastGoal_;
+        std::unique_ptr<ExpLib::SpatialHash> canceledHash_;
+        std::unique_ptr<dynamicParams> sbeParams_; // dynamicParamsCB が書き込む値, 評価の始めに syncParams で上の dynamic parameters に写す
+
+        // functions
+        void storeParams(bool lastGoalEffect, double lastGoalTolerance, bool canceledGoalEffect, double canceledGoalTolerance);
+        virtual void syncParams(void);
 
     public:
         SensorBasedExploration();
         virtual ~SensorBasedExploration();
-        bool getGoal(geometry_msgs::PointStamped& goal);
+        virtual bool getGoal(geometry_msgs::PointStamped& goal);
 };
 
 #endif // SENSOR_BASED_EXPLORATION_H
\ No newline at end of file
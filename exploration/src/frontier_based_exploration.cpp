@@ -5,6 +5,7 @@
 #include <geometry_msgs/PointStamped.h>
 #include <geometry_msgs/PoseStamped.h>
 #include <exploration_libraly/struct.h>
+#include <exploration_libraly/spatial_hash.h>
 #include <exploration_msgs/FrontierArray.h>
 #include <exploration_msgs/PointArray.h>
 #include <exploration/frontier_based_exploration_parameter_reconfigureConfig.h>
@@ -14,12 +15,13 @@ namespace ExCov = ExpLib::Convert;
 namespace ExStc = ExpLib::Struct;
 
 FrontierBasedExploration::FrontierBasedExploration()
-    :frontier_(new ExStc::subStruct<exploration_msgs::FrontierArray>("frontier", 1))
-    ,pose_(new ExStc::subStruct<geometry_msgs::PoseStamped>("pose", 1))
-    ,canceled_(new ExStc::subStruct<exploration_msgs::PointArray>("canceled_goals",1))
+    :frontier_(new ExStc::LatestValue<exploration_msgs::FrontierArray>("frontier", 1))
+    ,pose_(new ExStc::LatestValue<geometry_msgs::PoseStamped>("pose", 1))
+    ,canceled_(new ExStc::LatestValue<exploration_msgs::PointArray>("canceled_goals",1))
     ,goal_(new ExStc::pubStruct<geometry_msgs::PointStamped>("goal", 1, true))
-    ,drs_(new dynamic_reconfigure::Server<exploration::frontier_based_exploration_parameter_reconfigureConfig>(ros::NodeHandle("~/frontier_based_exploration")))
-    ,lastGoal_(new geometry_msgs::Point()){
+    ,drs_(new dynamic_reconfigure::Server<exploration::frontier_based_exploration_parameter_reconfigureConfig>(ExStc::mainQueueHandle("~/frontier_based_exploration")))
+    ,lastGoal_(new geometry_msgs::Point())
+    ,canceledHash_(new ExpLib::SpatialHash()){
     loadParams();
     drs_->setCallback(boost::bind(&FrontierBasedExploration::dynamicParamsCB,this, _1, _2));
 }
@@ -30,17 +32,19 @@ FrontierBasedExploration::~FrontierBasedExploration(){
 
 bool FrontierBasedExploration::getGoal(geometry_msgs::PointStamped& goal){
     // frontierの読み込み
-    if(frontier_->q.callOne(ros::WallDuration(1)) || frontier_->data.frontiers.size()==0){
-        ROS_ERROR_STREAM("Can't read frontier or don't find frontier");  
+    const exploration_msgs::FrontierArrayConstPtr frontier = frontier_->waitFor(ros::WallDuration(1),FRONTIER_MAX_AGE);
+    if(!frontier || frontier->frontiers.size()==0){
+        ROS_ERROR_STREAM("Can't read frontier, frontier is stale (age : " << frontier_->age() << " s) or don't find frontier");  
         return false;
     }
     // pose の読みこみ
-    if(pose_->q.callOne(ros::WallDuration(1))){
-        ROS_ERROR_STREAM("Can't read pose");
+    const geometry_msgs::PoseStampedConstPtr pose = pose_->waitFor(ros::WallDuration(1),POSE_MAX_AGE);
+    if(!pose){
+        ROS_ERROR_STREAM("Can't read pose or pose is stale (age : " << pose_->age() << " s)");
         return false;
     }
 
-    std::vector<exploration_msgs::Frontier> frontiers(frontier_->data.frontiers);
+    std::vector<exploration_msgs::Frontier> frontiers(frontier->frontiers);
 
     // frontier を条件でフィルタする
     if(LAST_GOAL_EFFECT){
@@ -48,12 +52,11 @@ bool FrontierBasedExploration::getGoal(geometry_msgs::PointStamped& goal){
 		frontiers.erase(std::move(removeResult),frontiers.end());
     }
 
-    if(CANCELED_GOAL_EFFECT && !canceled_->q.callOne(ros::WallDuration(1)) && canceled_->data.points.size()!=0){
+    const exploration_msgs::PointArrayConstPtr canceled = canceled_->get();
+    if(CANCELED_GOAL_EFFECT && canceled && canceled->points.size()!=0){
+        canceledHash_->syncAppendOnly(canceled->points,CANCELED_GOAL_TOLERANCE);
         auto removeResult = std::remove_if(frontiers.begin(),frontiers.end(),[this](exploration_msgs::Frontier& f){
-            for(const auto& c : canceled_->data.points){
-                if(Eigen::Vector2d(f.point.x - c.x, f.point.y - c.y).norm()<CANCELED_GOAL_TOLERANCE) return true;
-            }
-            return false;
+            return canceledHash_->contains(Eigen::Vector2d(f.point.x, f.point.y),CANCELED_GOAL_TOLERANCE);
         });
 		frontiers.erase(std::move(removeResult),frontiers.end());
     }
@@ -63,7 +66,7 @@ bool FrontierBasedExploration::getGoal(geometry_msgs::PointStamped& goal){
         return false;
     }
 
-    return decideGoal(goal, frontiers, pose_->data);
+    return decideGoal(goal, frontiers, *pose);
 }
 
 bool FrontierBasedExploration::decideGoal(geometry_msgs::PointStamped& goal, const std::vector<exploration_msgs::Frontier>& frontiers,const geometry_msgs::PoseStamped& pose){
@@ -105,6 +108,8 @@ void FrontierBasedExploration::loadParams(void){
     // static parameters
     nh.param<std::string>("fbe_parameter_file_path",FBE_PARAMETER_FILE_PATH,"fbe_last_parameters.yaml");
     nh.param<bool>("output_fbe_parameters",OUTPUT_FBE_PARAMETERS,true);
+    nh.param<double>("frontier_max_age",FRONTIER_MAX_AGE,10.0);
+    nh.param<double>("pose_max_age",POSE_MAX_AGE,2.0);
 }
 
 void FrontierBasedExploration::dynamicParamsCB(exploration::frontier_based_exploration_parameter_reconfigureConfig &cfg, uint32_t level){
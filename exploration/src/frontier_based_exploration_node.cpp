@@ -12,7 +12,7 @@ int main(int argc, char *argv[]){
     FrontierBasedExploration fbe;
     Movement mv;
 
-    ExpLib::Struct::subStruct<std_msgs::Bool> end("end",1);
+    ExpLib::Struct::LatestValue<std_msgs::Bool> end("end",1);
     geometry_msgs::PointStamped goal;
 
     ros::NodeHandle p("~");
@@ -28,8 +28,9 @@ int main(int argc, char *argv[]){
 
     while(ros::ok()){
         if(fbe.getGoal(goal) && !DEBUG) mv.moveToGoal(goal);
-        if(AUTO_FINISH && !end.q.callOne(ros::WallDuration(0.5)) && end.data.data) break;
-        ros::spinOnce();
+        else ros::WallDuration(0.5).sleep(); // 入力を待たずに返るので, 目標が無い間に空回りしないようにする
+        if(AUTO_FINISH && end.get() && end.get()->data) break;
+        ExpLib::Struct::spinMainQueue();
     }
 
     ROS_INFO_STREAM("exploration finish !! -> time : " << ros::Duration(ros::Time::now()-start).toSec() << " [s]");
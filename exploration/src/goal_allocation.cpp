@@ -0,0 +1,174 @@
+#include <exploration/goal_allocation.h>
+#include <exploration_libraly/assignment.h>
+#include <exploration_libraly/convert.h>
+#include <exploration_libraly/path_planning.h>
+#include <exploration_libraly/struct.h>
+#include <exploration_libraly/utility.h>
+#include <exploration_msgs/BranchArray.h>
+#include <exploration_msgs/FrontierArray.h>
+#include <exploration_msgs/RobotInfoArray.h>
+#include <geometry_msgs/PointStamped.h>
+#include <navfn/navfn_ros.h>
+#include <tf/transform_listener.h>
+#include <cfloat>
+#include <cmath>
+
+namespace ExStc = ExpLib::Struct;
+namespace ExCov = ExpLib::Convert;
+namespace ExUtl = ExpLib::Utility;
+namespace ExAsn = ExpLib::Assignment;
+
+struct GoalAllocation::robotStruct{
+    std::unique_ptr<ExStc::LatestValue<exploration_msgs::BranchArray>> branch;
+    ros::Publisher pub;
+};
+
+struct GoalAllocation::targetStruct{
+    geometry_msgs::Point point;
+    double coeff; // 分岐の状態によるコストの倍率
+    targetStruct(const geometry_msgs::Point& p, double c);
+};
+GoalAllocation::targetStruct::targetStruct(const geometry_msgs::Point& p, double c):point(p),coeff(c){};
+
+GoalAllocation::GoalAllocation()
+    :robotArray_(new ExStc::LatestValue<exploration_msgs::RobotInfoArray>("robot_array", 1))
+    ,frontier_(new ExStc::LatestValue<exploration_msgs::FrontierArray>("frontier", 1))
+    ,pp_(new ExpLib::PathPlanning<navfn::NavfnROS>("allocation_costmap","allocation_planner"))
+    ,tfl_(new tf::TransformListener())
+    ,robots_(new std::unordered_map<std::string,robotStruct>()){
+    loadParams();
+}
+
+GoalAllocation::~GoalAllocation(){}
+
+void GoalAllocation::mainLoop(void){
+    ros::Rate rate(ALLOCATION_RATE);
+    while(ros::ok()){
+        ExStc::spinMainQueue();
+        allocate();
+        rate.sleep();
+    }
+}
+
+void GoalAllocation::robotRegistration(const exploration_msgs::RobotInfoArray& ria){
+    // robot_array に新しく現れたロボットの分岐を購読し, 目標を送る publisher を作る
+    for(const auto& ri : ria.info){
+        if(robots_->count(ri.name)) continue;
+        ROS_INFO_STREAM("add to allocation : " << ri.name);
+        robotStruct& robot = (*robots_)[ri.name];
+        robot.branch.reset(new ExStc::LatestValue<exploration_msgs::BranchArray>(ros::names::append(ri.name,BRANCH_TOPIC), 1));
+        robot.pub = ros::NodeHandle().advertise<geometry_msgs::PointStamped>(ros::names::append(ri.name,ALLOCATED_GOAL_TOPIC), 1);
+    }
+}
+
+void GoalAllocation::collectTargets(const exploration_msgs::FrontierArray& fa, std::vector<targetStruct>& targets){
+    // seamless_hybrid_exploration の filter と同じものを除く
+    for(const auto& f : fa.frontiers){
+        if(f.status == exploration_msgs::Frontier::ON_MAP || f.status == exploration_msgs::Frontier::NOT_USEFUL) continue;
+        targets.emplace_back(f.point,1.0);
+    }
+    // 分岐はどのロボットが見つけたものでも全てのロボットの候補にする
+    // 座標系が違う時はロボットごとに一度だけ変換を取得する
+    // 止まったロボットの分岐や向かい終わった分岐を候補に残し続けないように, BRANCH_MAX_AGE 秒より古い分岐は使わない
+    for(const auto& robot : *robots_){
+        const exploration_msgs::BranchArrayConstPtr branch = robot.second.branch->get(BRANCH_MAX_AGE);
+        if(!branch) continue;
+        const exploration_msgs::BranchArray& ba = *branch;
+        Eigen::Isometry2d transform = Eigen::Isometry2d::Identity();
+        if(!ba.branches.empty() && !ba.header.frame_id.empty() && ba.header.frame_id != fa.header.frame_id && !ExUtl::lookupTransform2d(*tfl_, fa.header.frame_id, ba.header.frame_id, transform)){
+            // 変換が取れない分岐は位置が分からないので候補にしない
+            ROS_WARN_STREAM("skip branches of " << robot.first << " : can't transform " << ba.header.frame_id << " to " << fa.header.frame_id);
+            continue;
+        }
+        for(const auto& b : ba.branches){
+            if(b.status == exploration_msgs::Branch::NEWER_DUPLICATION) continue;
+            geometry_msgs::Point p = b.point;
+            ExUtl::transformPoint2d(transform, p);
+            targets.emplace_back(p, b.status == exploration_msgs::Branch::OLDER_DUPLICATION ? DUPLICATE_COEFF : b.status == exploration_msgs::Branch::ON_MAP ? ON_MAP_COEFF : 1.0);
+        }
+    }
+}
+
+bool GoalAllocation::allocate(void){
+    const exploration_msgs::RobotInfoArrayConstPtr robotArray = robotArray_->waitFor(ros::WallDuration(1),ROBOT_ARRAY_MAX_AGE);
+    if(!robotArray || robotArray->info.size()==0){
+        ROS_ERROR_STREAM("Can't read robot_array, robot_array is stale (age : " << robotArray_->age() << " s) or don't find robot_array");
+        return false;
+    }
+    robotRegistration(*robotArray);
+
+    const exploration_msgs::FrontierArrayConstPtr frontier = frontier_->waitFor(ros::WallDuration(1),FRONTIER_MAX_AGE);
+    if(!frontier){
+        ROS_ERROR_STREAM("Can't read frontier or frontier is stale (age : " << frontier_->age() << " s)");
+        return false;
+    }
+
+    std::vector<targetStruct> targets;
+    collectTargets(*frontier,targets);
+    if(targets.size() == 0){
+        ROS_WARN_STREAM("Don't find target");
+        return false;
+    }
+
+    // 各ロボットから全ての目標候補への距離と向き, ロボットごとに距離場を一度だけ作る
+    const std::vector<exploration_msgs::RobotInfo>& robots = robotArray->info;
+    std::vector<geometry_msgs::Point> points;
+    points.reserve(targets.size());
+    for(const auto& t : targets) points.emplace_back(t.point);
+
+    Eigen::MatrixXd distance(robots.size(),targets.size());
+    Eigen::MatrixXd angle(robots.size(),targets.size());
+    ExpLib::DistanceField field;
+    for(int r=0,re=robots.size();r!=re;++r){
+        const geometry_msgs::Point& p = robots[r].pose.position;
+        const bool valid = pp_->getDistanceField(p,points,field);
+        const Eigen::Vector2d v1 = ExCov::qToVector2d(robots[r].pose.orientation);
+        for(int t=0,te=targets.size();t!=te;++t){
+            double d = 0;
+            Eigen::Vector2d v2;
+            if(!valid || !pp_->getDistanceAndVec(field,targets[t].point,d,v2)){
+                //最終手段で直線距離を計算
+                v2 = Eigen::Vector2d(targets[t].point.x - p.x, targets[t].point.y - p.y);
+                d = v2.norm();
+                v2.normalize();
+            }
+            distance(r,t) = d;
+            angle(r,t) = std::abs(std::acos(std::max(-1.0,std::min(1.0,v1.dot(v2)))));
+        }
+    }
+
+    // seamless_hybrid_exploration と同じ重みでコストにし, 合計が最小になるように割り当てる
+    const double maxDistance = std::max(distance.maxCoeff(),DBL_MIN);
+    const double maxAngle = std::max(angle.maxCoeff(),DBL_MIN);
+    Eigen::RowVectorXd coeff(targets.size());
+    for(int t=0,te=targets.size();t!=te;++t) coeff(t) = targets[t].coeff;
+    const Eigen::MatrixXd cost = ((DISTANCE_WEIGHT * distance.array() / maxDistance + DIRECTION_WEIGHT * angle.array() / maxAngle).rowwise() * coeff.array()).matrix();
+    const std::vector<int> assignment = ExAsn::hungarian(cost);
+
+    // 目標が足りずに割り当てられなかったロボットには送らない (ロボット側で自分で決める)
+    for(int r=0,re=robots.size();r!=re;++r){
+        if(assignment[r] < 0) continue;
+        geometry_msgs::PointStamped goal;
+        goal.header.frame_id = frontier->header.frame_id;
+        goal.header.stamp = ros::Time::now();
+        goal.point = targets[assignment[r]].point;
+        robots_->at(robots[r].name).pub.publish(goal);
+        ROS_DEBUG_STREAM(robots[r].name << " -> (" << goal.point.x << ", " << goal.point.y << ")");
+    }
+    return true;
+}
+
+void GoalAllocation::loadParams(void){
+    ros::NodeHandle nh("~");
+    // static parameters
+    nh.param<double>("allocation_rate", ALLOCATION_RATE, 0.5);
+    nh.param<double>("distance_weight", DISTANCE_WEIGHT, 2.5);
+    nh.param<double>("direction_weight", DIRECTION_WEIGHT, 1.5);
+    nh.param<double>("duplicate_coeff", DUPLICATE_COEFF, 1.2);
+    nh.param<double>("on_map_coeff", ON_MAP_COEFF, 1.1);
+    nh.param<std::string>("branch_topic", BRANCH_TOPIC, "branch");
+    nh.param<std::string>("allocated_goal_topic", ALLOCATED_GOAL_TOPIC, "allocated_goal");
+    nh.param<double>("robot_array_max_age", ROBOT_ARRAY_MAX_AGE, 5.0);
+    nh.param<double>("frontier_max_age", FRONTIER_MAX_AGE, 10.0);
+    nh.param<double>("branch_max_age", BRANCH_MAX_AGE, 2.0);
+}
@@ -0,0 +1,9 @@
+#include <exploration/goal_allocation.h>
+#include <ros/ros.h>
+
+int main(int argc, char *argv[]){
+    ros::init(argc, argv, "goal_allocation");
+    GoalAllocation ga;
+    ga.mainLoop();
+    return 0;
+}
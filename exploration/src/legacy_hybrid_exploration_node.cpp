@@ -14,9 +14,9 @@ int main(int argc, char* argv[]){
 
     SensorBasedExploration sbe;
     FrontierBasedExploration fbe;
-    ExpLib::Struct::subStruct<std_msgs::Int8> loop("loop_closure_counter/count",1);
+    ExpLib::Struct::LatestValue<std_msgs::Int8> loop("loop_closure_counter/count",1);
 
-    ExpLib::Struct::subStruct<std_msgs::Bool> end("end",1);
+    ExpLib::Struct::LatestValue<std_msgs::Bool> end("end",1);
 
     geometry_msgs::PointStamped goal;
     ros::NodeHandle p("~");
@@ -49,10 +49,10 @@ int main(int argc, char* argv[]){
         };
 
         while(ros::ok()){
-            if(!loop.q.callOne(ros::WallDuration(0.5)) && loop.data.data >= LOOP_COUNT_THRESHOLD) break;
+            if(loop.get() && loop.get()->data >= LOOP_COUNT_THRESHOLD) break;
             branchTimer() && sbe.getGoal(goal) && !DEBUG ? mv.moveToGoal(goal) : mv.moveToForward();
-            if(AUTO_FINISH && !end.q.callOne(ros::WallDuration(0.5)) && end.data.data) break;
-            ros::spinOnce();
+            if(AUTO_FINISH && end.get() && end.get()->data) break;
+            ExpLib::Struct::spinMainQueue();
         }
     }
 
@@ -63,8 +63,9 @@ int main(int argc, char* argv[]){
     {
         while(ros::ok()){
             if(fbe.getGoal(goal) && !DEBUG) mv.moveToGoal(goal);
-            if(AUTO_FINISH && !end.q.callOne(ros::WallDuration(0.5)) && end.data.data) break;
-            ros::spinOnce();
+            else ros::WallDuration(0.5).sleep(); // 入力を待たずに返るので, 目標が無い間に空回りしないようにする
+            if(AUTO_FINISH && end.get() && end.get()->data) break;
+            ExpLib::Struct::spinMainQueue();
         }
     }
 
@@ -13,8 +13,10 @@
 #include <geometry_msgs/PoseStamped.h>
 #include <geometry_msgs/Twist.h>
 #include <kobuki_msgs/BumperEvent.h>
+#include <nav_msgs/OccupancyGrid.h>
 #include <sensor_msgs/LaserScan.h>
 #include <exploration_libraly/path_planning.h>
+#include <exploration_libraly/scan_preprocessor.h>
 #include <navfn/navfn_ros.h>
 #include <exploration_msgs/AvoidanceStatus.h>
 
@@ -23,18 +25,30 @@ namespace ExUtl = ExpLib::Utility;
 namespace ExCos = ExpLib::Construct;
 namespace ExCov = ExpLib::Convert;
 
+namespace{
+    // 値が来るまで待つ, next なら今持っている値より新しい値を待つ (動かしながら姿勢を追う時), ros が止まったら空
+    // maxAge が正なら maxAge 秒より古い値は使わずに新しい値を待つ
+    template <typename T>
+    boost::shared_ptr<const T> waitMessage(ExStc::LatestValue<T>& lv, const std::string& name, bool next=false, double maxAge=0){
+        boost::shared_ptr<const T> msg;
+        while(!(msg = next ? lv.waitForNext(ros::WallDuration(1.0)) : lv.waitFor(ros::WallDuration(1.0),maxAge)) && ros::ok()) ROS_INFO_STREAM("Waiting " << name << " ...");
+        return msg;
+    }
+}
+
 Movement::Movement()
-    :scan_(new ExStc::subStruct<sensor_msgs::LaserScan>("scan",1)) // sub
-    ,pose_(new ExStc::subStruct<geometry_msgs::PoseStamped>("pose",1)) // sub
-    ,bumper_(new ExStc::subStruct<kobuki_msgs::BumperEvent>("bumper",1)) // sub
+    :scan_(new ExStc::LatestValue<sensor_msgs::LaserScan>("scan",1)) // sub
+    ,pose_(new ExStc::LatestValue<geometry_msgs::PoseStamped>("pose",1)) // sub
+    ,bumper_(new ExStc::LatestValue<kobuki_msgs::BumperEvent>("bumper",1)) // sub
     ,velocity_(new ExStc::pubStruct<geometry_msgs::Twist>("velocity", 1)) //. pub
     ,previousOrientation_(1.0)
     ,pp_(new ExpLib::PathPlanning<navfn::NavfnROS>("movement_costmap","movement_planner")) //クラス名
+    ,scanPre_(new ExpLib::ScanPreprocessor())
     ,goal_(new ExStc::pubStruct<geometry_msgs::PointStamped>("goal", 1, true)) // pub
     ,road_(new ExStc::pubStruct<geometry_msgs::PointStamped>("road", 1)) // pub
-    ,gCostmap_(new ExStc::subStruct<nav_msgs::OccupancyGrid>("global_costmap",1)) // pub
+    ,gCostmap_(new ExStc::LatestValue<nav_msgs::OccupancyGrid>("global_costmap",1)) // pub
     ,avoStatus_(new ExStc::pubStruct<exploration_msgs::AvoidanceStatus>("movement_status",1))
-    ,drs_(new dynamic_reconfigure::Server<exploration::movement_parameter_reconfigureConfig>(ros::NodeHandle("~/movement"))){
+    ,drs_(new dynamic_reconfigure::Server<exploration::movement_parameter_reconfigureConfig>(ExStc::mainQueueHandle("~/movement"))){
     loadParams();
     drs_->setCallback(boost::bind(&Movement::dynamicParamsCB,this, _1, _2));
 }
@@ -48,25 +62,30 @@ void Movement::moveToGoal(geometry_msgs::PointStamped goal,bool sleep){
     
     while(!ac.waitForServer(ros::Duration(1.0)) && ros::ok()) ROS_INFO_STREAM("wait for action server << " << MOVEBASE_NAME);
 
-    if(pose_->q.callOne(ros::WallDuration(1.0))) return;
+    geometry_msgs::PoseStampedConstPtr pose = pose_->waitFor(ros::WallDuration(1.0),POSE_MAX_AGE);
+    if(!pose){
+        ROS_ERROR_STREAM("Can't read pose or pose is stale (age : " << pose_->age() << " s)");
+        return;
+    }
 
-    if(pose_->data.header.frame_id != goal.header.frame_id){
+    if(pose->header.frame_id != goal.header.frame_id){
         static bool initialized = false;
         static tf::TransformListener listener;
         if(!initialized){
-            listener.waitForTransform(pose_->data.header.frame_id, goal.header.frame_id, ros::Time(), ros::Duration(1.0));
+            listener.waitForTransform(pose->header.frame_id, goal.header.frame_id, ros::Time(), ros::Duration(1.0));
             initialized = true;
         }
-        ExUtl::coordinateConverter2d<void>(listener, pose_->data.header.frame_id, goal.header.frame_id, goal.point);
+        Eigen::Isometry2d transform;
+        if(ExUtl::lookupTransform2d(listener, pose->header.frame_id, goal.header.frame_id, transform)) ExUtl::transformPoint2d(transform, goal.point);
     }
 
-    if(lookupCostmap(pose_->data)){
-        escapeFromCostmap(pose_->data);
-        pose_->q.callOne(ros::WallDuration(1.0));
+    if(lookupCostmap(*pose)){
+        escapeFromCostmap(*pose);
+        pose = pose_->get(); // 脱出した後の姿勢
     } 
 
     move_base_msgs::MoveBaseGoal mbg;
-    mbg.target_pose.header.frame_id = pose_->data.header.frame_id;
+    mbg.target_pose.header.frame_id = pose->header.frame_id;
     mbg.target_pose.header.stamp = ros::Time::now();
 
     // 目標での姿勢
@@ -80,12 +99,12 @@ void Movement::moveToGoal(geometry_msgs::PointStamped goal,bool sleep){
     //     // rotation << cos(rotateTheta), -sin(rotateTheta), sin(rotateTheta), cos(rotateTheta);
     //     startToGoal = rotation * Eigen::Vector2d(goal.point.x-pose_->data.pose.position.x,goal.point.y-pose_->data.pose.position.y);
     // }
-    if(!pp_->getVec(pose_->data,ExCov::pointStampedToPoseStamped(goal),startToGoal)){
-        startToGoal = Eigen::Vector2d(goal.point.x-pose_->data.pose.position.x,goal.point.y-pose_->data.pose.position.y);
+    if(!pp_->getVec(*pose,ExCov::pointStampedToPoseStamped(goal),startToGoal)){
+        startToGoal = Eigen::Vector2d(goal.point.x-pose->pose.position.x,goal.point.y-pose->pose.position.y);
     }
 
     if(USE_ANGLE_BIAS){
-        double yaw = ExCov::qToYaw(pose_->data.pose.orientation);
+        double yaw = ExCov::qToYaw(pose->pose.orientation);
         // Eigen::Vector3d cross = Eigen::Vector3d(cos(yaw),sin(yaw),0.0).normalized().cross(Eigen::Vector3d(goal.point.x-pose_->data.pose.position.x,goal.point.y-pose_->data.pose.position.y,0.0).normalized());
         Eigen::Vector3d cross = Eigen::Vector3d(cos(yaw),sin(yaw),0.0).normalized().cross(Eigen::Vector3d(startToGoal.x(),startToGoal.y(),0.0).normalized());
         double rotateTheta = ANGLE_BIAS * M_PI/180 * (cross.z() > 0 ? 1.0 : cross.z() < 0 ? -1.0 : 0);
@@ -144,27 +163,31 @@ void Movement::moveToGoal(geometry_msgs::PointStamped goal,bool sleep){
 void Movement::moveToForward(void){
     ROS_INFO_STREAM("Moving Straight");
 
-    if(!bumper_->q.callOne(ros::WallDuration(1)) && bumperCollision(bumper_->data)) return; // 障害物に接触してないか確認
+    const kobuki_msgs::BumperEventConstPtr bumper = bumper_->getNew(); // 前回から新しく来た接触イベントだけを見る
+    if(bumper && bumperCollision(*bumper)) return; // 障害物に接触してないか確認
     
-    if(pose_->q.callOne(ros::WallDuration(1))) return;
+    const geometry_msgs::PoseStampedConstPtr pose = pose_->waitFor(ros::WallDuration(1),POSE_MAX_AGE);
+    if(!pose){
+        ROS_ERROR_STREAM("Can't read pose or pose is stale (age : " << pose_->age() << " s)");
+        return;
+    }
 
-    if(lookupCostmap(pose_->data)){
-        escapeFromCostmap(pose_->data);
-        pose_->q.callOne(ros::WallDuration(1.0));
-    } 
+    if(lookupCostmap(*pose)) escapeFromCostmap(*pose);
 
-    if(scan_->q.callOne(ros::WallDuration(1))) return;
+    // 同じスキャンで何度も避けないように次のスキャンを待つ (この関数を呼ぶループの周期はスキャンの周期になる)
+    const sensor_msgs::LaserScanConstPtr scan = scan_->waitForNext(ros::WallDuration(1));
+    if(!scan) return;
 
     if(APPROACH_WALL){
         double angle;
-        if(forwardWallDetection(scan_->data, angle)) VFHMove(scan_->data,std::move(angle));
-        else if(!roadCenterDetection(scan_->data)){
-            if(!VFHMove(scan_->data)) emergencyAvoidance(scan_->data);
+        if(forwardWallDetection(*scan, angle)) VFHMove(*scan,std::move(angle));
+        else if(!roadCenterDetection(*scan)){
+            if(!VFHMove(*scan)) emergencyAvoidance(*scan);
         }
     }
     else {
-        if(!roadCenterDetection(scan_->data)){
-            if(!VFHMove(scan_->data)) emergencyAvoidance(scan_->data);
+        if(!roadCenterDetection(*scan)){
+            if(!VFHMove(*scan)) emergencyAvoidance(*scan);
         }
     }
 }
@@ -173,9 +196,13 @@ void Movement::oneRotation(void){
     //ロボットがz軸周りに一回転する
     ROS_DEBUG_STREAM("rotation");
 
-    if(pose_->q.callOne(ros::WallDuration(1))) return;
+    geometry_msgs::PoseStampedConstPtr pose = pose_->waitFor(ros::WallDuration(1),POSE_MAX_AGE);
+    if(!pose){
+        ROS_ERROR_STREAM("Can't read pose or pose is stale (age : " << pose_->age() << " s)");
+        return;
+    }
 
-    double initYaw,yaw = ExCov::qToYaw(pose_->data.pose.orientation);
+    double initYaw,yaw = ExCov::qToYaw(pose->pose.orientation);
     double initSign = initYaw / std::abs(initYaw);
 
     if(std::isnan(initSign)) initSign = 1.0;
@@ -187,41 +214,43 @@ void Movement::oneRotation(void){
     for(int count=0;(count < 3 && (count < 2 || std::abs(yaw) < std::abs(initYaw))) && ros::ok();){
         double yawOld = yaw;
         velocity_->pub.publish(vel);
-        pose_->q.callOne(ros::WallDuration(1));
-        yaw = ExCov::qToYaw(pose_->data.pose.orientation);
+        if(const geometry_msgs::PoseStampedConstPtr next = pose_->waitForNext(ros::WallDuration(1))) pose = next;
+        yaw = ExCov::qToYaw(pose->pose.orientation);
         if(yawOld * yaw < 0) ++count;
     }
 }
 
 void Movement::halfRotation(void){
-    while(pose_->q.callOne(ros::WallDuration(1.0))&&ros::ok()) ROS_INFO_STREAM("Waiting pose ...");
-    geometry_msgs::Quaternion gq = pose_->data.pose.orientation;
+    const geometry_msgs::PoseStampedConstPtr pose = waitMessage(*pose_,"pose",false,POSE_MAX_AGE);
+    if(!pose) return;
+    geometry_msgs::Quaternion gq = pose->pose.orientation;
     // ExCov::tfQuaToGeoQua(tf::Quaternion(gq.x,gq.y,gq.z,gq.w) * tf::createQuaternionFromRPY(0, 0, M_PI/2));
-    rotationFromTo(pose_->data.pose.orientation,ExCov::tfQuaToGeoQua(tf::Quaternion(gq.x,gq.y,gq.z,gq.w) * tf::createQuaternionFromRPY(0, 0, M_PI)));
+    rotationFromTo(pose->pose.orientation,ExCov::tfQuaToGeoQua(tf::Quaternion(gq.x,gq.y,gq.z,gq.w) * tf::createQuaternionFromRPY(0, 0, M_PI)));
 }
 
 bool Movement::lookupCostmap(void){
-    while(pose_->q.callOne(ros::WallDuration(1.0))&&ros::ok()) ROS_INFO_STREAM("Waiting pose ...");
-    return lookupCostmap(pose_->data);
+    const geometry_msgs::PoseStampedConstPtr pose = waitMessage(*pose_,"pose",false,POSE_MAX_AGE);
+    return pose && lookupCostmap(*pose);
 }
 
 bool Movement::lookupCostmap(const geometry_msgs::PoseStamped& goal){
-    // コストマップを更新
-    while(gCostmap_->q.callOne(ros::WallDuration(1.0))&&ros::ok()) ROS_INFO_STREAM("Waiting global costmap ...");
+    // 受け取り済みの最新のコストマップを使う
+    const nav_msgs::OccupancyGridConstPtr map = waitMessage(*gCostmap_,"global costmap");
+    if(!map) return false;
     ROS_INFO_STREAM("get global costmap");
-    return lookupCostmap(goal,gCostmap_->data);
+    return lookupCostmap(goal,*map);
 }
 
 bool Movement::lookupCostmap(const geometry_msgs::PoseStamped& goal, const nav_msgs::OccupancyGrid& map){
     // true:被ってる, false:被ってない
     ROS_INFO_STREAM("lookup global costmap");
-    // コストマップの配列を二次元に変換
-    std::vector<std::vector<int8_t>> lmap(ExUtl::mapArray1dTo2d(map.data,map.info));
+    // コストマップの配列を二次元で参照
+    ExStc::GridView<const int8_t> lmap(ExStc::gridView(map));
     ExStc::mapSearchWindow msw(goal.pose.position,map.info,COSTMAP_MARGIN);
     for(int y=msw.top,ey=msw.bottom+1;y!=ey;++y){
         for(int x=msw.left,ex=msw.right+1;x!=ex;++x){
-            // if(lmap[x][y] > 0){
-            if(lmap[x][y] > 98){
+            // if(lmap(x,y) > 0){
+            if(lmap(x,y) > 98){
                 ROS_INFO_STREAM("current goal is over the costmap !!");
                 return true; //被ってたら終了
             }
@@ -237,11 +266,12 @@ void Movement::escapeFromCostmap(const geometry_msgs::PoseStamped& pose){
     // ローカルコストマップを分割して安全そうなエリアに向かって脱出
 
     // // コストマップ
-    while(gCostmap_->q.callOne(ros::WallDuration(1.0))&&ros::ok()) ROS_INFO_STREAM("Waiting global costmap ...");
+    const nav_msgs::OccupancyGridConstPtr map = waitMessage(*gCostmap_,"global costmap");
+    if(!map) return;
     ROS_INFO_STREAM("get global costmap");
-    std::vector<std::vector<int8_t>> gMap(ExUtl::mapArray1dTo2d(gCostmap_->data.data,gCostmap_->data.info));
+    ExStc::GridView<const int8_t> gMap(ExStc::gridView(*map));
 
-    ExStc::mapSearchWindow msw(pose.pose.position,gCostmap_->data.info,ESC_MAP_WIDTH,ESC_MAP_HEIGHT);
+    ExStc::mapSearchWindow msw(pose.pose.position,map->info,ESC_MAP_WIDTH,ESC_MAP_HEIGHT);
 
     const int gw = (msw.right-msw.left+1) / ESC_MAP_DIV_X;
     const int gh = (msw.bottom-msw.top+1) / ESC_MAP_DIV_Y;
@@ -259,10 +289,10 @@ void Movement::escapeFromCostmap(const geometry_msgs::PoseStamped& pose){
         for(int dw=0, dwe=ESC_MAP_DIV_X; dw!=dwe; ++dw){
             double risk = 0;
             for(int h=msw.top+dh*gh,he=msw.top+(dh+1)*gh;h!=he;++h){
-                for(int w=msw.left+dw*gw,we=msw.left+(dw+1)*gw;w!=we;++w) risk += gMap[w][h] >= 99 ? gMap[w][h] : 0;
+                for(const int8_t *it=gMap.row(h)+msw.left+dw*gw,*ite=gMap.row(h)+msw.left+(dw+1)*gw;it!=ite;++it) risk += *it >= 99 ? *it : 0;
             }
             gmm[dw][dh].cIndex = Eigen::Vector2i((msw.left*2+(2*dw+1)*gw)/2,(msw.top*2+(2*dh+1)*gh)/2);
-            gmm[dw][dh].pose.position = ExUtl::mapIndexToCoordinate(gmm[dw][dh].cIndex.x(),gmm[dw][dh].cIndex.y(),gCostmap_->data.info);
+            gmm[dw][dh].pose.position = ExUtl::mapIndexToCoordinate(gmm[dw][dh].cIndex.x(),gmm[dw][dh].cIndex.y(),map->info);
             gmm[dw][dh].risk = risk / (gw*gh);
         }
     }
@@ -317,8 +347,9 @@ void Movement::escapeFromCostmap(const geometry_msgs::PoseStamped& pose){
         ROS_INFO_STREAM("escape to forward");
         publishMovementStatus("esc_costmap");
         velocity_->pub.publish(ExCos::msgTwist(FORWARD_VELOCITY,0));
-        while(pose_->q.callOne(ros::WallDuration(1.0))&&ros::ok()) ROS_INFO_STREAM("Waiting pose ...");
-        escapeFromCostmap(pose_->data);
+        const geometry_msgs::PoseStampedConstPtr next = waitMessage(*pose_,"pose",true);
+        if(!next) break;
+        escapeFromCostmap(*next);
     }
     loop = false;
     lastIndex << INT_MAX,INT_MAX;
@@ -335,32 +366,35 @@ void Movement::rotationFromTo(const geometry_msgs::Quaternion& from, const geome
     double sum = 0;
     double la = ExCov::qToYaw(from);
 
+    geometry_msgs::PoseStampedConstPtr pose = waitMessage(*pose_,"pose",false,POSE_MAX_AGE);
+    if(!pose) return;
+
     if(rotation>=0){    
-        while(ExCov::qToYaw(pose_->data.pose.orientation) > 0 && sum < rotation - ROTATION_TOLERANCE && ros::ok()){
+        while(ExCov::qToYaw(pose->pose.orientation) > 0 && sum < rotation - ROTATION_TOLERANCE && ros::ok()){
             velocity_->pub.publish(ExCos::msgTwist(0,ROTATION_VELOCITY));
-            while(pose_->q.callOne(ros::WallDuration(1.0))&&ros::ok()) ROS_INFO_STREAM("Waiting pose ...");
-            sum += ExCov::qToYaw(pose_->data.pose.orientation) > 0 ? ExCov::qToYaw(pose_->data.pose.orientation)-la : ExCov::qToYaw(pose_->data.pose.orientation) + M_PI;
-            la = ExCov::qToYaw(pose_->data.pose.orientation) > 0 ? ExCov::qToYaw(pose_->data.pose.orientation) : -M_PI;
+            if(!(pose = waitMessage(*pose_,"pose",true))) return;
+            sum += ExCov::qToYaw(pose->pose.orientation) > 0 ? ExCov::qToYaw(pose->pose.orientation)-la : ExCov::qToYaw(pose->pose.orientation) + M_PI;
+            la = ExCov::qToYaw(pose->pose.orientation) > 0 ? ExCov::qToYaw(pose->pose.orientation) : -M_PI;
         }
         while(sum < rotation - ROTATION_TOLERANCE && ros::ok()){
             velocity_->pub.publish(ExCos::msgTwist(0,ROTATION_VELOCITY));
-            while(pose_->q.callOne(ros::WallDuration(1.0))&&ros::ok()) ROS_INFO_STREAM("Waiting pose ...");
-            sum += ExCov::qToYaw(pose_->data.pose.orientation)-la;
-            la = ExCov::qToYaw(pose_->data.pose.orientation);
+            if(!(pose = waitMessage(*pose_,"pose",true))) return;
+            sum += ExCov::qToYaw(pose->pose.orientation)-la;
+            la = ExCov::qToYaw(pose->pose.orientation);
         }
     }
     else{
-        while(ExCov::qToYaw(pose_->data.pose.orientation) < 0 && sum > rotation + ROTATION_TOLERANCE && ros::ok()){
+        while(ExCov::qToYaw(pose->pose.orientation) < 0 && sum > rotation + ROTATION_TOLERANCE && ros::ok()){
             velocity_->pub.publish(ExCos::msgTwist(0,-ROTATION_VELOCITY));
-            while(pose_->q.callOne(ros::WallDuration(1.0))&&ros::ok()) ROS_INFO_STREAM("Waiting pose ...");
-            sum += ExCov::qToYaw(pose_->data.pose.orientation) < 0 ? ExCov::qToYaw(pose_->data.pose.orientation)-la : ExCov::qToYaw(pose_->data.pose.orientation) - M_PI;
-            la = ExCov::qToYaw(pose_->data.pose.orientation) < 0 ? ExCov::qToYaw(pose_->data.pose.orientation) : M_PI;
+            if(!(pose = waitMessage(*pose_,"pose",true))) return;
+            sum += ExCov::qToYaw(pose->pose.orientation) < 0 ? ExCov::qToYaw(pose->pose.orientation)-la : ExCov::qToYaw(pose->pose.orientation) - M_PI;
+            la = ExCov::qToYaw(pose->pose.orientation) < 0 ? ExCov::qToYaw(pose->pose.orientation) : M_PI;
         }
         while(sum > rotation + ROTATION_TOLERANCE && ros::ok()){
             velocity_->pub.publish(ExCos::msgTwist(0,-ROTATION_VELOCITY));
-            while(pose_->q.callOne(ros::WallDuration(1.0))&&ros::ok()) ROS_INFO_STREAM("Waiting pose ...");
-            sum += ExCov::qToYaw(pose_->data.pose.orientation)-la;
-            la = ExCov::qToYaw(pose_->data.pose.orientation);
+            if(!(pose = waitMessage(*pose_,"pose",true))) return;
+            sum += ExCov::qToYaw(pose->pose.orientation)-la;
+            la = ExCov::qToYaw(pose->pose.orientation);
         }
     }
 }
@@ -375,8 +409,9 @@ bool Movement::resetGoal(geometry_msgs::PoseStamped& goal){
     int pc = 0;
     ros::Rate rate(RESET_GOAL_PATH_RATE);
     
-    while(pose_->q.callOne(ros::WallDuration(1.0))&&ros::ok()) ROS_INFO_STREAM("Waiting pose ...");
-    while(!pp_->createPath(pose_->data,goal,path) && ros::ok()){
+    geometry_msgs::PoseStampedConstPtr pose = waitMessage(*pose_,"pose",false,POSE_MAX_AGE);
+    if(!pose) return false;
+    while(!pp_->createPath(*pose,goal,path) && ros::ok()){
         ROS_INFO_STREAM("Waiting path ..."); // 一生パスが作れない場合もあるので注意
         if(++pc >= RESET_GOAL_PATH_LIMIT){
             ROS_WARN_STREAM("create path limit");
@@ -388,16 +423,17 @@ bool Movement::resetGoal(geometry_msgs::PoseStamped& goal){
     // パスを少し遡ったところを目的地にする
     ROS_INFO_STREAM("path size: " << path.size());
     ROS_INFO_STREAM("PATH_BACK_INTERVAL: " << PATH_BACK_INTERVAL);
-    while(gCostmap_->q.callOne(ros::WallDuration(1.0))&&ros::ok()) ROS_INFO_STREAM("Waiting global costmap ...");
+    const nav_msgs::OccupancyGridConstPtr map = waitMessage(*gCostmap_,"global costmap");
+    if(!map) return false;
 
     // ここの中でこすとまっぷにかからなくなるまで再計算
     for(int i=1;PATH_BACK_INTERVAL*i < path.size() && ros::ok();++i){
         ROS_INFO_STREAM("goal reset try : " << i);
-        if(!lookupCostmap(path[path.size() - PATH_BACK_INTERVAL*i],gCostmap_->data)){
-            while(pose_->q.callOne(ros::WallDuration(1.0))&&ros::ok()) ROS_INFO_STREAM("Waiting pose ...");
+        if(!lookupCostmap(path[path.size() - PATH_BACK_INTERVAL*i],*map)){
+            pose = pose_->get();
             goal = path[path.size() - PATH_BACK_INTERVAL*i];
             Eigen::Vector2d vec;
-            pp_->getVec(pose_->data,goal,vec,path);
+            pp_->getVec(*pose,goal,vec,path);
             goal.pose.orientation = ExCov::eigenQuaToGeoQua(Eigen::Quaterniond::FromTwoVectors(Eigen::Vector3d::UnitX(),Eigen::Vector3d(vec.x(),vec.y(),0.0)));
             return true;
         }
@@ -421,26 +457,18 @@ bool Movement::bumperCollision(const kobuki_msgs::BumperEvent& bumper){
 bool Movement::roadCenterDetection(const sensor_msgs::LaserScan& scan){
     ROS_INFO_STREAM("roadCenterDetection");
 
+    const geometry_msgs::PoseStampedConstPtr pose = pose_->get();
+    if(!pose) return false;
+
     static bool initialized = false;
     static tf::TransformListener listener;
     if(!initialized){
-        listener.waitForTransform(pose_->data.header.frame_id, scan.header.frame_id, ros::Time(), ros::Duration(1.0));
+        listener.waitForTransform(pose->header.frame_id, scan.header.frame_id, ros::Time(), ros::Duration(1.0));
         initialized = true;
     }
 
     ExStc::scanStruct ss(scan.ranges.size());
-
-    for(int i=0,e=scan.ranges.size();i!=e;++i){
-        if(!std::isnan(scan.ranges[i])){
-            double tempAngle = scan.angle_min+(scan.angle_increment*i);
-            if(scan.ranges[i]*cos(tempAngle) <= ROAD_CENTER_THRESHOLD){
-                ss.ranges.emplace_back(scan.ranges[i]);
-                ss.x.emplace_back(scan.ranges[i]*cos(tempAngle));
-                ss.y.emplace_back(scan.ranges[i]*sin(tempAngle));
-                ss.angles.emplace_back(std::move(tempAngle));
-            }
-        }
-    }
+    scanPre_->toScanStruct(scan,ss,ROAD_CENTER_THRESHOLD);
 
     if(ss.ranges.size() < 2){
         road_->pub.publish(geometry_msgs::PointStamped());
@@ -451,7 +479,10 @@ bool Movement::roadCenterDetection(const sensor_msgs::LaserScan& scan){
         if(std::abs(ss.y[i+1] - ss.y[i]) >= ROAD_THRESHOLD){
             ROS_DEBUG_STREAM("Road Center Found");
             //  通路中心座標pub
-            road_->pub.publish(ExCov::pointToPointStamped(ExUtl::coordinateConverter2d<geometry_msgs::Point>(listener, pose_->data.header.frame_id, scan.header.frame_id, ExCos::msgPoint((ss.x[i+1] + ss.x[i])/2, (ss.y[i+1] + ss.y[i])/2)),pose_->data.header.frame_id));
+            geometry_msgs::Point road = ExCos::msgPoint((ss.x[i+1] + ss.x[i])/2, (ss.y[i+1] + ss.y[i])/2);
+            Eigen::Isometry2d transform;
+            if(ExUtl::lookupTransform2d(listener, pose->header.frame_id, scan.header.frame_id, transform)) ExUtl::transformPoint2d(transform, road);
+            road_->pub.publish(ExCov::pointToPointStamped(road,pose->header.frame_id));
             publishMovementStatus("ROAD_CENTER");
             velocity_->pub.publish(velocityGenerator((ss.angles[i]+ss.angles[i+1])/2,FORWARD_VELOCITY,ROAD_CENTER_GAIN));
             return true;
@@ -473,25 +504,16 @@ bool Movement::VFHMove(const sensor_msgs::LaserScan& scan, double angle){
     std::swap(cp[0],cp[1]);
 
     // 目標角に一番近い要素番号を計算 0 radのときは特殊処理(要素サイズが偶数の場合))
+    // 角度は等間隔なので一番近い要素番号は割り算で求まる
     if(angle==0) ti = cp[0];
-    else{
-        double min = DBL_MAX;
-        for(int i=0,ie=scan.ranges.size();i!=ie;++i){
-            double diff = std::abs(angle - (scan.angle_min + scan.angle_increment * i));
-            if(diff < min){
-                min = std::move(diff);
-                ti = i;
-            }
-        }
-    }
+    else ti = std::min(std::max((int)std::round((angle - scan.angle_min) / scan.angle_increment),0),(int)scan.ranges.size()-1);
     // その方向が安全であるかを見る   
     ROS_INFO_STREAM("angle : " << angle << ", ranges.size() : " << scan.ranges.size() << ", ti : " << ti << ", ti(rad) : " << scan.angle_min + ti*scan.angle_increment);
 
     // 距離の再計算
     std::vector<float> scanCalced;
-    scanCalced.reserve(scan.ranges.size());
-    for(int i=0,e=scan.ranges.size();i!=e;++i)
-        scanCalced.emplace_back(CALC_RANGE_COS && !std::isnan(scan.ranges[i]) ? scan.ranges[i]*cos(scan.angle_min+(scan.angle_increment*i)) : scan.ranges[i]);
+    if(CALC_RANGE_COS) scanPre_->forwardRanges(scan,scanCalced);
+    else scanCalced = scan.ranges;
 
     // ここでrateがthreshold以下になるまでずらして計算
     int sw = 0;
@@ -547,9 +569,8 @@ bool Movement::emergencyAvoidance(const sensor_msgs::LaserScan& scan){
 
     // 距離の再計算
     std::vector<float> scanCalced;
-    scanCalced.reserve(scan.ranges.size());
-    for(int i=0,e=scan.ranges.size();i!=e;++i)
-        scanCalced.emplace_back(CALC_RANGE_COS && !std::isnan(scan.ranges[i]) ? scan.ranges[i]*cos(scan.angle_min+(scan.angle_increment*i)) : scan.ranges[i]);
+    if(CALC_RANGE_COS) scanPre_->forwardRanges(scan,scanCalced);
+    else scanCalced = scan.ranges;
 
     double NAN_RATE = 0.8;
 
@@ -634,6 +655,9 @@ bool Movement::forwardWallDetection(const sensor_msgs::LaserScan& scan, double&
 
 double Movement::sideSpaceDetection(const sensor_msgs::LaserScan& scan, int plus, int minus){
     ROS_INFO_STREAM("sideSpaceDetection");
+    // 前方向の距離 (nan はそのまま)
+    std::vector<float> forward;
+    scanPre_->forwardRanges(scan,forward);
     //minus
     int countNanMinus = 0;
     double maxSpaceMinus = 0;
@@ -644,7 +668,7 @@ double Movement::sideSpaceDetection(const sensor_msgs::LaserScan& scan, int plus
             double temp;
             for(int j=i+1;j!=minus;++j){
                 if(!std::isnan(scan.ranges[j])){
-                    temp = std::abs(scan.ranges[i]*cos(scan.angle_min + scan.angle_increment*i)-scan.ranges[j]*cos(scan.angle_min + scan.angle_increment*j));
+                    temp = std::abs(forward[i]-forward[j]);
                     break;
                 }
             }
@@ -663,7 +687,7 @@ double Movement::sideSpaceDetection(const sensor_msgs::LaserScan& scan, int plus
             double temp;
             for(int j=i-1;j!=-1;--j){
                 if(!std::isnan(scan.ranges[j])){
-                    temp = std::abs(scan.ranges[i]*cos(scan.angle_min + scan.angle_increment*i)-scan.ranges[j]*cos(scan.angle_min + scan.angle_increment*j));
+                    temp = std::abs(forward[i]-forward[j]);
                     break;
                 }
             }
@@ -708,10 +732,12 @@ void Movement::publishMovementStatus(const std::string& status){
     msg.descriptions.emplace_back("VFH_FAR_RANGE_THRESHOLD");
     msg.descriptions.emplace_back("VFH_NEAR_RANGE_THRESHOLD");
     msg.descriptions.emplace_back("EMERGENCY_THRESHOLD");
-    msg.scan_frame_id = scan_->data.header.frame_id;
-    msg.scan_angle_min = scan_->data.angle_min;
-    msg.scan_angle_max = scan_->data.angle_max;
-    msg.scan_angle_increment = scan_->data.angle_increment;
+    if(const sensor_msgs::LaserScanConstPtr scan = scan_->get()){
+        msg.scan_frame_id = scan->header.frame_id;
+        msg.scan_angle_min = scan->angle_min;
+        msg.scan_angle_max = scan->angle_max;
+        msg.scan_angle_increment = scan->angle_increment;
+    }
     msg.header.stamp = ros::Time::now();
     avoStatus_->pub.publish(msg);
 }
@@ -758,6 +784,7 @@ void Movement::loadParams(void){
     nh.param<std::string>("movebase_name", MOVEBASE_NAME, "move_base");
     nh.param<std::string>("movement_parameter_file_path",MOVEMENT_PARAMETER_FILE_PATH,"movement_last_parameters.yaml");
     nh.param<bool>("output_movement_parameters",OUTPUT_MOVEMENT_PARAMETERS,true);
+    nh.param<double>("pose_max_age",POSE_MAX_AGE,2.0);
 }
 
 void Movement::dynamicParamsCB(exploration::movement_parameter_reconfigureConfig &cfg, uint32_t level){
@@ -18,7 +18,7 @@ MultiExplorationSimulator::MultiExplorationSimulator()
     :poses_(new ExStc::pubStruct<geometry_msgs::PoseArray>("pose_array",1,true))
     ,branches_(new ExStc::pubStruct<visualization_msgs::Marker>("branch_array",1,true))
     ,frontiers_(new ExStc::pubStruct<visualization_msgs::Marker>("frontier_array",1,true))
-    ,drs_(new dynamic_reconfigure::Server<exploration::multi_exploration_simulatorConfig>(ros::NodeHandle("~/mulsim"))){
+    ,drs_(new dynamic_reconfigure::Server<exploration::multi_exploration_simulatorConfig>(ExStc::mainQueueHandle("~/mulsim"))){
     loadParams();
     drs_->setCallback(boost::bind(&MultiExplorationSimulator::dynamicParamsCB,this, _1, _2));
     robotPoses_->header.frame_id = MAP_FRAME_ID;
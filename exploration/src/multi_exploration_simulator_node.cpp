@@ -1,6 +1,7 @@
 #include <ros/ros.h>
 #include <exploration/multi_exploration_simulator.h> // 必須
 #include <exploration/seamless_hybrid_exploration.h> // SeamlessHybrid sh(pp);　用
+#include <exploration_libraly/struct.h>
 
 int main(int argc, char* argv[]){
     /**
@@ -27,7 +28,7 @@ int main(int argc, char* argv[]){
     fnType fn = std::bind(&SeamlessHybridExploration::simBridge,&sbe,std::placeholders::_1,std::placeholders::_2,std::placeholders::_3);
 
     while(ros::ok()){
-        ros::spinOnce(); // 必須
+        ExpLib::Struct::spinMainQueue(); // 必須
         mes.updateParams(fn); // 必須 <- 引数に上で作った渡したい関数のオブジェクトを入れる
     }
     return 0;
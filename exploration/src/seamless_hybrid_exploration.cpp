@@ -4,6 +4,7 @@
 #include <exploration_libraly/struct.h>
 #include <exploration_libraly/enum.h>
 #include <exploration_libraly/path_planning.h>
+#include <exploration_libraly/spatial_hash.h>
 #include <exploration_libraly/utility.h>
 #include <exploration_msgs/BranchArray.h>
 #include <exploration_msgs/FrontierArray.h>
@@ -14,6 +15,12 @@
 #include <exploration/seamless_hybrid_exploration_parameter_reconfigureConfig.h>
 #include <exploration/sensor_based_exploration_parameter_reconfigureConfig.h>
 #include <geometry_msgs/Point.h>
+#include <geometry_msgs/PointStamped.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <numeric>
+#include <thread>
 
 namespace ExStc = ExpLib::Struct;
 namespace ExCov = ExpLib::Convert;
@@ -28,60 +35,160 @@ struct SeamlessHybridExploration::maxValue{
 SeamlessHybridExploration::maxValue::maxValue():distance(-DBL_MAX),angle(-DBL_MAX){};
 
 struct SeamlessHybridExploration::preCalcResult{
-    struct value{
-        double distance;
-        double angle;
-        value();
-        value(const double d, const double a);
-    };
     geometry_msgs::Point point;
     // ExEnm::DuplicationStatus branchStatus;
     uint8_t branchStatus;
-    std::vector<value> values;
     preCalcResult();
 };
 SeamlessHybridExploration::preCalcResult::preCalcResult(){};
-SeamlessHybridExploration::preCalcResult::value::value(){};
-SeamlessHybridExploration::preCalcResult::value::value(const double d, const double a):distance(d),angle(a){};
+
+// 起点 (ownPreCalc_, otherPreCalc_ の順) × frontier の距離と角度
+struct SeamlessHybridExploration::preCalcMatrix{
+    Eigen::MatrixXd distance;
+    Eigen::MatrixXd angle;
+};
+
+struct SeamlessHybridExploration::goalWorker{
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool running;
+    bool ready; // goal がまだ取り出されていない
+    bool taken; // 一度でも goal を取り出した
+    bool async; // goalWorkerLoop で評価している, この間 lastGoal_ は取り出した goal でだけ更新する
+    geometry_msgs::PointStamped goal;
+    geometry_msgs::Point takenGoal; // 最後に取り出した goal, lastGoal_ はこちらを使う
+    goalWorker();
+};
+SeamlessHybridExploration::goalWorker::goalWorker():running(false),ready(false),taken(false),async(false){};
+
+// dynamicParamsCB が書き込み, 評価の始めに syncParams で dynamic parameters に写す
+struct SeamlessHybridExploration::dynamicParams{
+    std::mutex mutex;
+    double DISTANCE_WEIGHT;
+    double DIRECTION_WEIGHT;
+    double OTHER_ROBOT_WEIGHT;
+    double DUPLICATE_COEFF;
+    double ON_MAP_COEFF;
+    double LAST_GOAL_WEIGHT;
+    bool USE_ALLOCATED_GOAL;
+    double ALLOCATED_GOAL_TIMEOUT;
+    bool AF_BRANCH_AND_BOUND;
+    double AF_APPROXIMATION_TOLERANCE;
+};
 
 SeamlessHybridExploration::SeamlessHybridExploration()
-    :robotArray_(new ExStc::subStruct<exploration_msgs::RobotInfoArray>("robot_array", 1))
-    ,frontier_(new ExStc::subStruct<exploration_msgs::FrontierArray>("frontier", 1))
+    :robotArray_(new ExStc::LatestValue<exploration_msgs::RobotInfoArray>("robot_array", 1))
+    ,frontier_(new ExStc::LatestValue<exploration_msgs::FrontierArray>("frontier", 1))
+    ,allocatedGoal_(new ExStc::LatestValue<geometry_msgs::PointStamped>("allocated_goal", 1))
     // ,useFro_(new ExStc::pubStruct<exploration_msgs::FrontierArray>("useful_frontier", 1, true))
     // ,onMapFro_(new ExStc::pubStruct<exploration_msgs::FrontierArray>("on_map_frontier", 1, true))
     ,pp_(new ExpLib::PathPlanning<navfn::NavfnROS>("seamless_costmap","seamless_planner"))
-    ,drs_(new dynamic_reconfigure::Server<exploration::seamless_hybrid_exploration_parameter_reconfigureConfig>(ros::NodeHandle("~/seamless_hybrid_exploration")))
+    ,drs_(new dynamic_reconfigure::Server<exploration::seamless_hybrid_exploration_parameter_reconfigureConfig>(ExStc::mainQueueHandle("~/seamless_hybrid_exploration")))
     // ,ls_(new std::vector<ExStc::listStruct>())
     ,ba_(new exploration_msgs::BranchArray())
     ,fa_(new exploration_msgs::FrontierArray())
     ,ria_(new exploration_msgs::RobotInfoArray())
     ,ps_(new geometry_msgs::PoseStamped())
-    ,mVal_(new maxValue()){
+    ,mVal_(new maxValue())
+    ,pcm_(new preCalcMatrix())
+    ,gw_(new goalWorker())
+    ,sheParams_(new dynamicParams()){
     loadParams();
     SensorBasedExploration::drs_->clearCallback();
     SeamlessHybridExploration::drs_->setCallback(boost::bind(&SeamlessHybridExploration::dynamicParamsCB,this, _1, _2));
 }
 
 SeamlessHybridExploration::~SeamlessHybridExploration(){
-    if(OUTPUT_SHE_PARAMETERS) outputParams();
+    stopGoalThread();
+    if(OUTPUT_SHE_PARAMETERS){
+        syncParams();
+        outputParams();
+    }
+}
+
+void SeamlessHybridExploration::startGoalThread(double period){
+    // 目標の評価を別のスレッドで回し続け, 制御ループは latestGoal で結果を取り出すだけにする
+    // 購読は LatestValue の共有キューで受け取るので getGoal はどのスレッドからでも読めるが, 評価の状態 (ba_, pcm_ など) を持つので以降 getGoal はこのスレッドからだけ呼ぶ
+    if(gw_->running) return;
+    gw_->running = true;
+    gw_->async = true;
+    gw_->thread = std::thread(&SeamlessHybridExploration::goalWorkerLoop, this, period);
+}
+
+void SeamlessHybridExploration::stopGoalThread(void){
+    {
+        std::lock_guard<std::mutex> lock(gw_->mutex);
+        if(!gw_->running) return;
+        gw_->running = false;
+    }
+    gw_->cv.notify_all();
+    gw_->thread.join();
+    gw_->async = false;
+}
+
+bool SeamlessHybridExploration::latestGoal(geometry_msgs::PointStamped& goal){
+    // 新しい goal があれば取り出す, 待たない
+    std::lock_guard<std::mutex> lock(gw_->mutex);
+    if(!gw_->ready) return false;
+    goal = gw_->goal;
+    gw_->ready = false;
+    gw_->taken = true;
+    gw_->takenGoal = goal.point;
+    return true;
+}
+
+void SeamlessHybridExploration::goalWorkerLoop(double period){
+    std::unique_lock<std::mutex> lock(gw_->mutex);
+    while(gw_->running){
+        const auto next = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(period));
+        // 評価した goal ではなく実際に向かった goal を最後の goal とする
+        if(gw_->taken) *lastGoal_ = gw_->takenGoal;
+        lock.unlock();
+
+        geometry_msgs::PointStamped goal;
+        const bool found = getGoal(goal);
+
+        lock.lock();
+        if(found){
+            gw_->goal = goal;
+            gw_->ready = true;
+        }
+        gw_->cv.wait_until(lock, next, [this]{return !gw_->running;});
+    }
+}
+
+void SeamlessHybridExploration::setLastGoal(const geometry_msgs::Point& point){
+    // 別のスレッドで評価している時はまだ向かうか分からないので, latestGoal で取り出されてから goalWorkerLoop で更新する
+    if(!gw_->async) *lastGoal_ = point;
+}
+
+bool SeamlessHybridExploration::getGoal(geometry_msgs::PointStamped& goal){
+    // goal_allocation から割り当てがあればそちらを使い, 無ければ自分で決める
+    // 分岐が無く frontier だけで進む時も割り当てを使うので, 分岐を読む前に見る
+    syncParams();
+    if(USE_ALLOCATED_GOAL && allocatedGoal(goal)) return true;
+    return SensorBasedExploration::getGoal(goal);
 }
 
 // bool SeamlessHybridExploration::decideGoal(geometry_msgs::PointStamped& goal, const std::vector<ExStc::listStruct>& ls, const geometry_msgs::PoseStamped& pose){
 bool SeamlessHybridExploration::decideGoal(geometry_msgs::PointStamped& goal, const exploration_msgs::BranchArray& ba, const geometry_msgs::PoseStamped& pose){
-    if(robotArray_->q.callOne(ros::WallDuration(1))){
-        ROS_ERROR_STREAM("Can't read robot_array or don't find robot_array"); 
+    const exploration_msgs::RobotInfoArrayConstPtr robotArray = robotArray_->waitFor(ros::WallDuration(1),ROBOT_ARRAY_MAX_AGE);
+    if(!robotArray){
+        ROS_ERROR_STREAM("Can't read robot_array or robot_array is stale (age : " << robotArray_->age() << " s)"); 
         return false;
     }
-    if(frontier_->q.callOne(ros::WallDuration(1))){
-        ROS_ERROR_STREAM("Can't read frontier or don't find frontier"); 
+    const exploration_msgs::FrontierArrayConstPtr frontier = frontier_->waitFor(ros::WallDuration(1),FRONTIER_MAX_AGE);
+    if(!frontier){
+        ROS_ERROR_STREAM("Can't read frontier or frontier is stale (age : " << frontier_->age() << " s)"); 
         return false;
     }
 
     *ps_ = pose;
     // *ls_ = ls;
     *ba_ = ba;
-    *fa_ = frontier_->data;
-    *ria_ = robotArray_->data;
+    *fa_ = *frontier;
+    *ria_ = *robotArray;
 
     // if(!filter(*ls_, *fa_, *ria_)) return false;
     if(!filter(*ba_, *fa_, *ria_)) return false;
@@ -94,19 +201,20 @@ bool SeamlessHybridExploration::decideGoal(geometry_msgs::PointStamped& goal){
     // preCalc(*ls_, *fa_, *ria_, *ps_);
     preCalc(*ba_, *fa_, *ria_, *ps_);
 
-    // 評価計算
-    auto evaluation = [this](const double d, const double a){return DISTANCE_WEIGHT * d / mVal_->distance + DIRECTION_WEIGHT * a / mVal_->angle;};
+    // 評価計算, 全ての起点と frontier の組をまとめて計算する
+    const int own = ownPreCalc_.size();
+    const int other = otherPreCalc_.size();
+    const Eigen::ArrayXXd evaluation = DISTANCE_WEIGHT * pcm_->distance.array() / mVal_->distance + DIRECTION_WEIGHT * pcm_->angle.array() / mVal_->angle;
+
+    // 他のロボットの項は自分の候補によらないので frontier ごとに一度だけ求める
+    Eigen::RowVectorXd subE = Eigen::RowVectorXd::Constant(evaluation.cols(), DBL_MAX);
+    if(other != 0) subE = evaluation.bottomRows(other).colwise().sum().matrix();
+    const Eigen::ArrayXd sum = (evaluation.topRows(own).rowwise() + (OTHER_ROBOT_WEIGHT / subE.array())).rowwise().prod();
 
     double minE = DBL_MAX;
 
-    for(int m=0,me=ownPreCalc_.size();m!=me;++m){
-        double e = 1;
-        for(int i=0,ie=ownPreCalc_[m].values.size();i!=ie;++i){
-            double subE = 0;
-            if(otherPreCalc_.size()==0) subE = DBL_MAX;
-            else for(const auto& opc : otherPreCalc_) subE += evaluation(opc.values[i].distance, opc.values[i].angle);
-            e *= evaluation(ownPreCalc_[m].values[i].distance, ownPreCalc_[m].values[i].angle) + (OTHER_ROBOT_WEIGHT/subE);
-        }
+    for(int m=0,me=own;m!=me;++m){
+        double e = sum(m);
 
         if(ownPreCalc_[m].branchStatus==exploration_msgs::Branch::OLDER_DUPLICATION) e *= DUPLICATE_COEFF;
         else if(ownPreCalc_[m].branchStatus==exploration_msgs::Branch::ON_MAP) e *= ON_MAP_COEFF;
@@ -121,7 +229,27 @@ bool SeamlessHybridExploration::decideGoal(geometry_msgs::PointStamped& goal){
             if(m == me -1) return false;
         }
     }
-    *lastGoal_ = goal.point;
+    setLastGoal(goal.point);
+    return true;
+}
+
+bool SeamlessHybridExploration::allocatedGoal(geometry_msgs::PointStamped& goal){
+    // 届いている割り当てだけを読む, 古い割り当ては goal_allocation が止まっているとみなして使わない
+    const geometry_msgs::PointStampedConstPtr allocated = allocatedGoal_->get();
+    if(!allocated) return false;
+    const geometry_msgs::PointStamped& ag = *allocated;
+    if(ag.header.stamp.isZero() || ros::Duration(ros::Time::now() - ag.header.stamp).toSec() > ALLOCATED_GOAL_TIMEOUT) return false;
+
+    // 自分で決める時と同じく最後の目標とキャンセルされた目標の近くは使わない
+    const exploration_msgs::PointArrayConstPtr canceled = canceled_->get();
+    if(CANCELED_GOAL_EFFECT && canceled) canceledHash_->syncAppendOnly(canceled->points,CANCELED_GOAL_TOLERANCE);
+    if(LAST_GOAL_EFFECT && Eigen::Vector2d(ag.point.x - lastGoal_->x, ag.point.y - lastGoal_->y).norm()<LAST_GOAL_TOLERANCE) return false;
+    if(CANCELED_GOAL_EFFECT && canceledHash_->contains(Eigen::Vector2d(ag.point.x, ag.point.y),CANCELED_GOAL_TOLERANCE)) return false;
+
+    ROS_INFO_STREAM("use allocated goal : (" << ag.point.x << ", " << ag.point.y << ")");
+    goal = ag;
+    goal_->pub.publish(goal);
+    setLastGoal(goal.point);
     return true;
 }
 
@@ -169,50 +297,41 @@ bool SeamlessHybridExploration::filter(exploration_msgs::BranchArray& ba, explor
 void SeamlessHybridExploration::preCalc(const exploration_msgs::BranchArray& ba, const exploration_msgs::FrontierArray& fa, const exploration_msgs::RobotInfoArray& ria, const geometry_msgs::PoseStamped& pose){
     ownPreCalc_ = std::vector<preCalcResult>();
     otherPreCalc_ = std::vector<preCalcResult>();
-    *mVal_ = maxValue();
 
     // auto calc = [&,this](const geometry_msgs::Point& p,const Eigen::Vector2d& v1, ExEnm::DuplicationStatus branchStatus){
-    auto calc = [&,this](const geometry_msgs::Point& p,const Eigen::Vector2d& v1, uint8_t branchStatus){
+    auto init = [](const geometry_msgs::Point& p, uint8_t branchStatus){
         SeamlessHybridExploration::preCalcResult pcr;
         pcr.point = p;
         pcr.branchStatus = branchStatus;
-        // Eigen::Vector2d v1 = ExCov::qToVector2d(ps.orientation);
-        pcr.values.reserve(fa.frontiers.size());
-        for(const auto& f : fa.frontiers){
-            // 目標地点での向きをpathの最後の方の移動で決めたい
-            Eigen::Vector2d v2;
-            double distance;
-            if(!pp_->getDistanceAndVec(ExCov::pointToPoseStamped(p,pose.header.frame_id),ExCov::pointToPoseStamped(f.point,fa.header.frame_id),distance,v2)){
-                v2 = Eigen::Vector2d(f.point.x - p.x, f.point.y - p.y).normalized();
-                // if(!pp_->getDistance(ExCov::pointToPoseStamped(p,pose.header.frame_id),ExCov::pointToPoseStamped(f.point,fa.header.frame_id),distance)){
-                    //最終手段で直線距離を計算
-                    distance = Eigen::Vector2d(f.point.x - p.x, f.point.y - p.y).norm();
-                // }                
-            }
-            double angle = std::abs(acos(v1.dot(v2)));
-            pcr.values.emplace_back(preCalcResult::value(distance,angle));
-            if(angle > mVal_->angle) mVal_->angle = std::move(angle);
-            if(distance > mVal_->distance) mVal_->distance = std::move(distance);
-        }
         return pcr;
     };
+    std::vector<Eigen::Vector2d> v1s; // 各起点での向き, ownPreCalc_, otherPreCalc_ の順
 
     // ownPreCalc_.reserve(ls.size()+1);
     ownPreCalc_.reserve(ba.branches.size()+1);
     otherPreCalc_.reserve(ria.info.size());
+    v1s.reserve(ba.branches.size()+1+ria.info.size());
+
+    // 経路は makePlan を起点と frontier の組ごとに呼ばずに, 起点ごとの距離場から引く
+    ExpLib::DistanceField field;
 
     // 分岐領域の計算
+    std::vector<geometry_msgs::Point> branchPoints;
+    branchPoints.reserve(ba.branches.size());
+    for(const auto& b : ba.branches) branchPoints.emplace_back(b.point);
+    const bool poseField = pp_->getDistanceField(pose.pose.position,branchPoints,field);
     double forward = 0;
     // for(const auto& l : ls){
     for(const auto& b : ba.branches){
         double distance;
         Eigen::Vector2d v1;
-        if(!pp_->getDistanceAndVec(pose,ExCov::pointToPoseStamped(b.point,pose.header.frame_id),distance,v1)){
+        if(!poseField || !pp_->getDistanceAndVec(field,b.point,distance,v1)){
             v1 = Eigen::Vector2d(b.point.x - pose.pose.position.x, b.point.y - pose.pose.position.y);
             distance = v1.lpNorm<1>();
             v1.normalize();
         }
-        ownPreCalc_.emplace_back(calc(b.point,v1,b.status));
+        ownPreCalc_.emplace_back(init(b.point,b.status));
+        v1s.emplace_back(v1);
         forward += distance;
     }
     // forward /= ls.size();
@@ -220,10 +339,69 @@ void SeamlessHybridExploration::preCalc(const exploration_msgs::BranchArray& ba,
     // 直進時の計算
     Eigen::Vector2d fwdV1 = ExCov::qToVector2d(pose.pose.orientation); 
     // ownPreCalc_.emplace_back(calc(ExCov::vector2dToPoint(Eigen::Vector2d(pose.pose.position.x,pose.pose.position.y)+forward*fwdV1),fwdV1,ExEnm::DuplicationStatus::NOT_DUPLECATION));
-    ownPreCalc_.emplace_back(calc(ExCov::vector2dToPoint(Eigen::Vector2d(pose.pose.position.x,pose.pose.position.y)+forward*fwdV1),fwdV1,exploration_msgs::Branch::NORMAL));
+    ownPreCalc_.emplace_back(init(ExCov::vector2dToPoint(Eigen::Vector2d(pose.pose.position.x,pose.pose.position.y)+forward*fwdV1),exploration_msgs::Branch::NORMAL));
+    v1s.emplace_back(fwdV1);
     // 他のロボットに関する計算
     // for(const auto& ri : ria.info) otherPreCalc_.emplace_back(calc(ri.pose.position,ExCov::qToVector2d(ri.pose.orientation),ExEnm::DuplicationStatus::NOT_DUPLECATION));
-    for(const auto& ri : ria.info) otherPreCalc_.emplace_back(calc(ri.pose.position,ExCov::qToVector2d(ri.pose.orientation),exploration_msgs::Branch::NORMAL));
+    for(const auto& ri : ria.info){
+        otherPreCalc_.emplace_back(init(ri.pose.position,exploration_msgs::Branch::NORMAL));
+        v1s.emplace_back(ExCov::qToVector2d(ri.pose.orientation));
+    }
+
+    // 起点 (分岐領域, 直進時の地点, 他のロボット) から各 frontier への距離と向き
+    std::vector<preCalcResult*> sources;
+    std::vector<geometry_msgs::Point> sourcePoints;
+    sources.reserve(v1s.size());
+    sourcePoints.reserve(v1s.size());
+    for(auto&& pcr : ownPreCalc_) sources.emplace_back(&pcr);
+    for(auto&& pcr : otherPreCalc_) sources.emplace_back(&pcr);
+    for(const auto& pcr : sources) sourcePoints.emplace_back(pcr->point);
+    pcm_->distance.resize(sources.size(),fa.frontiers.size());
+    pcm_->angle.resize(sources.size(),fa.frontiers.size());
+    std::vector<geometry_msgs::Point> frontierPoints;
+    frontierPoints.reserve(fa.frontiers.size());
+    for(const auto& f : fa.frontiers) frontierPoints.emplace_back(f.point);
+
+    auto setValue = [&,this](int s, int i, bool found, double distance, Eigen::Vector2d v2){
+        // 目標地点での向きをpathの最後の方の移動で決めたい
+        const geometry_msgs::Point& p = sources[s]->point;
+        const geometry_msgs::Point& f = fa.frontiers[i].point;
+        if(!found){
+            v2 = Eigen::Vector2d(f.x - p.x, f.y - p.y).normalized();
+            //最終手段で直線距離を計算
+            distance = Eigen::Vector2d(f.x - p.x, f.y - p.y).norm();
+        }
+        pcm_->distance(s,i) = distance;
+        pcm_->angle(s,i) = std::abs(acos(v1s[s].dot(v2)));
+    };
+
+    // 起点と frontier の少ない方から距離場を作る, frontier から作る時は起点から frontier への経路を逆にたどる
+    if(sources.size() <= fa.frontiers.size()){
+        for(int s=0,se=sources.size();s!=se;++s){
+            const bool valid = pp_->getDistanceField(sources[s]->point,frontierPoints,field);
+            for(int i=0,ie=fa.frontiers.size();i!=ie;++i){
+                double distance = 0;
+                Eigen::Vector2d v2;
+                setValue(s,i,valid && pp_->getDistanceAndVec(field,fa.frontiers[i].point,distance,v2),distance,v2);
+            }
+        }
+    }
+    else{
+        for(int i=0,ie=fa.frontiers.size();i!=ie;++i){
+            const bool valid = pp_->getDistanceField(fa.frontiers[i].point,sourcePoints,field);
+            for(int s=0,se=sources.size();s!=se;++s){
+                double distance = 0;
+                Eigen::Vector2d v2;
+                setValue(s,i,valid && pp_->getDistanceAndVec(field,sources[s]->point,distance,v2,true),distance,v2);
+            }
+        }
+    }
+
+    *mVal_ = maxValue();
+    if(pcm_->distance.size() != 0){
+        mVal_->distance = pcm_->distance.maxCoeff();
+        mVal_->angle = pcm_->angle.maxCoeff();
+    }
 }
 
 bool SeamlessHybridExploration::forwardTargetDetection(void){
@@ -233,28 +411,31 @@ bool SeamlessHybridExploration::forwardTargetDetection(void){
 
     ROS_DEBUG_STREAM("function : forwardTargetDetection");  
 
-    if(pose_->q.callOne(ros::WallDuration(1))){
-        ROS_ERROR_STREAM("Can't read pose");
+    const geometry_msgs::PoseStampedConstPtr pose = pose_->waitFor(ros::WallDuration(1),POSE_MAX_AGE);
+    if(!pose){
+        ROS_ERROR_STREAM("Can't read pose or pose is stale (age : " << pose_->age() << " s)");
         return true;
     }
 
-    if(branch_->q.callOne(ros::WallDuration(1)) || frontier_->q.callOne(ros::WallDuration(1))){
-        ROS_ERROR_STREAM("Can't read target");
+    const exploration_msgs::BranchArrayConstPtr branch = branch_->waitFor(ros::WallDuration(1),BRANCH_MAX_AGE);
+    const exploration_msgs::FrontierArrayConstPtr frontier = frontier_->waitFor(ros::WallDuration(1),FRONTIER_MAX_AGE);
+    if(!branch || !frontier){
+        ROS_ERROR_STREAM("Can't read target or target is stale (branch age : " << branch_->age() << " s, frontier age : " << frontier_->age() << " s)");
         return true;
     }
 
     // 自分の姿勢と自分の位置からターゲット候補の位置の角度を計算
-    Eigen::Vector2d v1 = ExCov::qToVector2d(pose_->data.pose.orientation);
+    Eigen::Vector2d v1 = ExCov::qToVector2d(pose->pose.orientation);
     double allowAngle = M_PI / 2;
     double allowDistance = 3.0;
 
-    ROS_INFO_STREAM("robot : (" << pose_->data.pose.position.x << ", " << pose_->data.pose.position.y << ", " << ExCov::qToYaw(pose_->data.pose.orientation) << ")");
+    ROS_INFO_STREAM("robot : (" << pose->pose.position.x << ", " << pose->pose.position.y << ", " << ExCov::qToYaw(pose->pose.orientation) << ")");
 
-    for(const auto& b : branch_->data.branches){
+    for(const auto& b : branch->branches){
         Eigen::Vector2d v2;
         double d;
         // if(!pp_->getVecInit(pose_->data,ExCov::pointToPoseStamped(b.point,branch_->data.header.frame_id),v2)){
-            v2 = Eigen::Vector2d(b.point.x - pose_->data.pose.position.x, b.point.y - pose_->data.pose.position.y);
+            v2 = Eigen::Vector2d(b.point.x - pose->pose.position.x, b.point.y - pose->pose.position.y);
             d = v2.norm();   
             v2.normalize();
         // }
@@ -267,11 +448,11 @@ bool SeamlessHybridExploration::forwardTargetDetection(void){
         }
     }
 
-    for(const auto& f : frontier_->data.frontiers){
+    for(const auto& f : frontier->frontiers){
         Eigen::Vector2d v2;
         double d;
         // if(!pp_->getVecInit(pose_->data,ExCov::pointToPoseStamped(f.point,frontier_->data.header.frame_id),v2)){
-            v2 = Eigen::Vector2d(f.point.x - pose_->data.pose.position.x, f.point.y - pose_->data.pose.position.y);   
+            v2 = Eigen::Vector2d(f.point.x - pose->pose.position.x, f.point.y - pose->pose.position.y);   
             d = v2.norm();   
             v2.normalize();
         // }
@@ -298,24 +479,28 @@ bool SeamlessHybridExploration::forwardTargetDetection(void){
 
 bool SeamlessHybridExploration::getGoalAF(geometry_msgs::PointStamped& goal){
     // 面積の条件で切り替えた後の目標
-    if(frontier_->q.callOne(ros::WallDuration(1))){
-        ROS_ERROR_STREAM("Can't read frontier or don't find frontier"); 
+    syncParams();
+    if(USE_ALLOCATED_GOAL && allocatedGoal(goal)) return true;
+
+    const exploration_msgs::FrontierArrayConstPtr frontier = frontier_->waitFor(ros::WallDuration(1),FRONTIER_MAX_AGE);
+    if(!frontier){
+        ROS_ERROR_STREAM("Can't read frontier or frontier is stale (age : " << frontier_->age() << " s)"); 
         return false;
     }
 
-    if(pose_->q.callOne(ros::WallDuration(1))){
-        ROS_ERROR_STREAM("Can't read pose");
+    const geometry_msgs::PoseStampedConstPtr pose = pose_->waitFor(ros::WallDuration(1),POSE_MAX_AGE);
+    if(!pose){
+        ROS_ERROR_STREAM("Can't read pose or pose is stale (age : " << pose_->age() << " s)");
         return false;
     }
 
-    std::vector<exploration_msgs::Frontier> frontiers(frontier_->data.frontiers);
+    std::vector<exploration_msgs::Frontier> frontiers(frontier->frontiers);
 
-    if(CANCELED_GOAL_EFFECT && !canceled_->q.callOne(ros::WallDuration(1)) && canceled_->data.points.size()!=0){
+    const exploration_msgs::PointArrayConstPtr canceled = canceled_->get();
+    if(CANCELED_GOAL_EFFECT && canceled && canceled->points.size()!=0){
+        canceledHash_->syncAppendOnly(canceled->points,CANCELED_GOAL_TOLERANCE);
 		frontiers.erase(std::remove_if(frontiers.begin(),frontiers.end(),[this](exploration_msgs::Frontier& f){
-            for(const auto& c : canceled_->data.points){
-                if(Eigen::Vector2d(f.point.x - c.x, f.point.y - c.y).norm()<CANCELED_GOAL_TOLERANCE) return true;
-            }
-            return false;
+            return canceledHash_->contains(Eigen::Vector2d(f.point.x, f.point.y),CANCELED_GOAL_TOLERANCE);
         }),frontiers.end());
     }
 
@@ -324,6 +509,24 @@ bool SeamlessHybridExploration::getGoalAF(geometry_msgs::PointStamped& goal){
         return false;
     }
 
+    auto publishGoal = [&,this]{
+        // 最後の目標と同じところだったら新しいゴールとして返さない
+        if(Eigen::Vector2d(lastGoal_->x-goal.point.x,lastGoal_->y-goal.point.y).norm()< LAST_GOAL_TOLERANCE) return false;
+
+        goal.header.frame_id = frontier->header.frame_id;
+        goal.header.stamp = ros::Time::now();
+        goal_->pub.publish(goal);
+
+        setLastGoal(goal.point);
+
+        return true;
+    };
+
+    if(AF_BRANCH_AND_BOUND){
+        goal.point = branchAndBoundAF(frontiers,*pose,frontier->header.frame_id);
+        return publishGoal();
+    }
+
     int STATUS_SIZE = 3;
 
     std::vector<std::tuple<double,double,double,geometry_msgs::Point,uint8_t>> distAng; // distance, angle, lastgoal, frontier, status
@@ -337,14 +540,20 @@ bool SeamlessHybridExploration::getGoalAF(geometry_msgs::PointStamped& goal){
 
     // usefulなやつの中で距離(path)の近いやつが良い -> frontierと距離と角度の重みのやつ
     // 無いときはnot_usefulなやつで
-    Eigen::Vector2d v1 = ExCov::qToVector2d(pose_->data.pose.orientation);
-    for(const auto& f : frontiers){
+    Eigen::Vector2d v1 = ExCov::qToVector2d(pose->pose.orientation);
+    // 各 frontier までの経路はまとめて並列に求める
+    std::vector<std::pair<geometry_msgs::PoseStamped,geometry_msgs::PoseStamped>> queries;
+    queries.reserve(frontiers.size());
+    for(const auto& f : frontiers) queries.emplace_back(*pose,ExCov::pointToPoseStamped(f.point,frontier->header.frame_id));
+    const auto paths = pp_->planBatch(queries);
+    for(int i=0,ie=frontiers.size();i!=ie;++i){
+        const exploration_msgs::Frontier& f = frontiers[i];
         // 目標地点での向きをpathの最後の方の移動で決めたい
-        Eigen::Vector2d v2;
-        double distance;
-        if(!pp_->getDistanceAndVec(pose_->data,ExCov::pointToPoseStamped(f.point,frontier_->data.header.frame_id),distance,v2)){
-            v2 = Eigen::Vector2d(f.point.x - pose_->data.pose.position.x, f.point.y - pose_->data.pose.position.y).normalized();
-            distance = Eigen::Vector2d(f.point.x - pose_->data.pose.position.x, f.point.y - pose_->data.pose.position.y).norm();       
+        Eigen::Vector2d v2 = paths[i].vec;
+        double distance = paths[i].distance;
+        if(!paths[i].success){
+            v2 = Eigen::Vector2d(f.point.x - pose->pose.position.x, f.point.y - pose->pose.position.y).normalized();
+            distance = Eigen::Vector2d(f.point.x - pose->pose.position.x, f.point.y - pose->pose.position.y).norm();       
         }
         double angle = std::abs(acos(v1.dot(v2)));
         double last = Eigen::Vector2d(lastGoal_->x-f.point.x,lastGoal_->y-f.point.y).norm();
@@ -374,16 +583,80 @@ bool SeamlessHybridExploration::getGoalAF(geometry_msgs::PointStamped& goal){
     std::sort(valList.begin(),valList.end(),[](const std::pair<geometry_msgs::Point,double>& l, const std::pair<geometry_msgs::Point,double>& r){return l.second < r.second;});
     goal.point = valList[0].first;
 
-    // 最後の目標と同じところだったら新しいゴールとして返さない
-    if(Eigen::Vector2d(lastGoal_->x-goal.point.x,lastGoal_->y-goal.point.y).norm()< LAST_GOAL_TOLERANCE) return false;
-
-    goal.header.frame_id = frontier_->data.header.frame_id;
-    goal.header.stamp = ros::Time::now();
-    goal_->pub.publish(goal);
-
-    *lastGoal_ = goal.point;
+    return publishGoal();
+}
 
-    return true;
+geometry_msgs::Point SeamlessHybridExploration::branchAndBoundAF(const std::vector<exploration_msgs::Frontier>& frontiers, const geometry_msgs::PoseStamped& pose, const std::string& frame){
+    // getGoalAF と同じ評価で, 経路を求める前に分かる下界で候補を絞る
+    // 正規化に使う最大値は経路を全て求めないと分からないので, 直線での距離と向きの最大で代える
+    // 経路は直線より短くならず向きの項は 0 以上なので, 直線距離と向き 0 での評価は下界になる
+    // 下界 * (1 + af_approximation_tolerance) が今の最良以上の候補は計画しない (最良の評価の (1 + tolerance) 倍以内の目標を返す)
+    const int STATUS_SIZE = 3;
+    const Eigen::Vector2d v1 = ExCov::qToVector2d(pose.pose.orientation);
+
+    struct candidate{
+        double straight; // 直線距離
+        double angle; // 直線での向き
+        double last; // 最後の目標からの距離
+        double coeff; // 状態による倍率
+        double bound;
+    };
+    std::vector<candidate> candidates(frontiers.size());
+    double distNorm = DBL_MIN;
+    double angNorm = DBL_MIN;
+    double lastMax = DBL_MIN;
+    for(int i=0,ie=frontiers.size();i!=ie;++i){
+        const geometry_msgs::Point& f = frontiers[i].point;
+        const Eigen::Vector2d v2(f.x - pose.pose.position.x, f.y - pose.pose.position.y);
+        candidate& c = candidates[i];
+        c.straight = v2.norm();
+        c.angle = std::abs(acos(std::max(-1.0,std::min(1.0,v1.dot(v2.normalized())))));
+        c.last = Eigen::Vector2d(lastGoal_->x - f.x, lastGoal_->y - f.y).norm();
+        c.coeff = (1.0 + frontiers[i].status) / STATUS_SIZE;
+        distNorm = std::max(distNorm, c.straight);
+        angNorm = std::max(angNorm, c.angle);
+        lastMax = std::max(lastMax, c.last);
+    }
+    for(auto&& c : candidates) c.bound = (DISTANCE_WEIGHT * c.straight / distNorm + LAST_GOAL_WEIGHT * c.last / lastMax) * c.coeff;
+
+    std::vector<int> order(candidates.size());
+    std::iota(order.begin(),order.end(),0);
+    std::sort(order.begin(),order.end(),[&candidates](int l, int r){return candidates[l].bound < candidates[r].bound;});
+
+    // 下界の小さい順に, 最良を上回りうる候補を planBatch で同時に求められる数ずつ計画する
+    const int chunk = std::max(1, pp_->getThreads());
+    const double margin = 1.0 + AF_APPROXIMATION_TOLERANCE;
+    double best = DBL_MAX;
+    int bestIndex = order.front();
+    int planned = 0;
+    std::vector<int> indices;
+    std::vector<std::pair<geometry_msgs::PoseStamped,geometry_msgs::PoseStamped>> queries;
+    for(int k=0,ke=order.size();k!=ke && candidates[order[k]].bound * margin < best;){
+        indices.clear();
+        queries.clear();
+        for(;k!=ke && (int)indices.size()<chunk && candidates[order[k]].bound * margin < best;++k){
+            indices.emplace_back(order[k]);
+            queries.emplace_back(pose,ExCov::pointToPoseStamped(frontiers[order[k]].point,frame));
+        }
+        const auto paths = pp_->planBatch(queries);
+        for(int j=0,je=indices.size();j!=je;++j){
+            const candidate& c = candidates[indices[j]];
+            double distance = c.straight;
+            double angle = c.angle;
+            if(paths[j].success){
+                distance = paths[j].distance;
+                angle = std::abs(acos(std::max(-1.0,std::min(1.0,v1.dot(paths[j].vec)))));
+            }
+            const double e = (DISTANCE_WEIGHT * distance / distNorm + DIRECTION_WEIGHT * angle / angNorm + LAST_GOAL_WEIGHT * c.last / lastMax) * c.coeff;
+            if(e < best){
+                best = e;
+                bestIndex = indices[j];
+            }
+        }
+        planned += indices.size();
+    }
+    ROS_DEBUG_STREAM("branch and bound : planned " << planned << " / " << frontiers.size() << " frontiers");
+    return frontiers[bestIndex].point;
 }
 
 void SeamlessHybridExploration::simBridge(std::vector<geometry_msgs::Pose>& r, std::vector<geometry_msgs::Point>& b, std::vector<geometry_msgs::Point>& f){
@@ -432,6 +705,7 @@ void SeamlessHybridExploration::simBridge(std::vector<geometry_msgs::Pose>& r, s
     *ria_ = ria;
 
     geometry_msgs::PointStamped goal;
+    syncParams();
     decideGoal(goal);
 
     pp.createPath(*ps_,ExCov::pointStampedToPoseStamped(goal));
@@ -450,23 +724,61 @@ void SeamlessHybridExploration::loadParams(void){
     nh.param<double>("duplicate_coeff", DUPLICATE_COEFF, 1.2);
     nh.param<double>("on_map_coeff", ON_MAP_COEFF, 1.1);
     nh.param<double>("last_goal_weight", LAST_GOAL_WEIGHT, 1.2);
+    nh.param<bool>("use_allocated_goal", USE_ALLOCATED_GOAL, true);
+    nh.param<double>("allocated_goal_timeout", ALLOCATED_GOAL_TIMEOUT, 5.0);
+    nh.param<bool>("af_branch_and_bound", AF_BRANCH_AND_BOUND, false);
+    nh.param<double>("af_approximation_tolerance", AF_APPROXIMATION_TOLERANCE, 0.0);
     // static parameters
     nh.param<std::string>("robot_name", ROBOT_NAME, "robot1");
     nh.param<std::string>("she_parameter_file_path",SHE_PARAMETER_FILE_PATH,"she_last_parameters.yaml");
     nh.param<bool>("output_she_parameters",OUTPUT_SHE_PARAMETERS,true);
+    nh.param<double>("branch_max_age",BRANCH_MAX_AGE,2.0);
+    nh.param<double>("pose_max_age",POSE_MAX_AGE,2.0);
+    nh.param<double>("robot_array_max_age",ROBOT_ARRAY_MAX_AGE,5.0);
+    nh.param<double>("frontier_max_age",FRONTIER_MAX_AGE,10.0);
+
+    storeParams(LAST_GOAL_EFFECT, LAST_GOAL_TOLERANCE, CANCELED_GOAL_EFFECT, CANCELED_GOAL_TOLERANCE);
+    std::lock_guard<std::mutex> lock(sheParams_->mutex);
+    sheParams_->DISTANCE_WEIGHT = DISTANCE_WEIGHT;
+    sheParams_->DIRECTION_WEIGHT = DIRECTION_WEIGHT;
+    sheParams_->OTHER_ROBOT_WEIGHT = OTHER_ROBOT_WEIGHT;
+    sheParams_->DUPLICATE_COEFF = DUPLICATE_COEFF;
+    sheParams_->ON_MAP_COEFF = ON_MAP_COEFF;
+    sheParams_->LAST_GOAL_WEIGHT = LAST_GOAL_WEIGHT;
+    sheParams_->USE_ALLOCATED_GOAL = USE_ALLOCATED_GOAL;
+    sheParams_->ALLOCATED_GOAL_TIMEOUT = ALLOCATED_GOAL_TIMEOUT;
+    sheParams_->AF_BRANCH_AND_BOUND = AF_BRANCH_AND_BOUND;
+    sheParams_->AF_APPROXIMATION_TOLERANCE = AF_APPROXIMATION_TOLERANCE;
 }
 
 void SeamlessHybridExploration::dynamicParamsCB(exploration::seamless_hybrid_exploration_parameter_reconfigureConfig &cfg, uint32_t level){
-    LAST_GOAL_EFFECT = cfg.last_goal_effect;
-    LAST_GOAL_TOLERANCE = cfg.last_goal_tolerance;
-    CANCELED_GOAL_EFFECT = cfg.canceled_goal_effect;
-    CANCELED_GOAL_TOLERANCE = cfg.canceled_goal_tolerance;
-    DISTANCE_WEIGHT = cfg.distance_weight;
-    DIRECTION_WEIGHT = cfg.direction_weight;
-    OTHER_ROBOT_WEIGHT = cfg.other_robot_weight;
-    DUPLICATE_COEFF = cfg.duplicate_coeff;
-    ON_MAP_COEFF = cfg.on_map_coeff;
-    LAST_GOAL_WEIGHT = cfg.last_goal_weight;
+    storeParams(cfg.last_goal_effect, cfg.last_goal_tolerance, cfg.canceled_goal_effect, cfg.canceled_goal_tolerance);
+    std::lock_guard<std::mutex> lock(sheParams_->mutex);
+    sheParams_->DISTANCE_WEIGHT = cfg.distance_weight;
+    sheParams_->DIRECTION_WEIGHT = cfg.direction_weight;
+    sheParams_->OTHER_ROBOT_WEIGHT = cfg.other_robot_weight;
+    sheParams_->DUPLICATE_COEFF = cfg.duplicate_coeff;
+    sheParams_->ON_MAP_COEFF = cfg.on_map_coeff;
+    sheParams_->LAST_GOAL_WEIGHT = cfg.last_goal_weight;
+    sheParams_->USE_ALLOCATED_GOAL = cfg.use_allocated_goal;
+    sheParams_->ALLOCATED_GOAL_TIMEOUT = cfg.allocated_goal_timeout;
+    sheParams_->AF_BRANCH_AND_BOUND = cfg.af_branch_and_bound;
+    sheParams_->AF_APPROXIMATION_TOLERANCE = cfg.af_approximation_tolerance;
+}
+
+void SeamlessHybridExploration::syncParams(void){
+    SensorBasedExploration::syncParams();
+    std::lock_guard<std::mutex> lock(sheParams_->mutex);
+    DISTANCE_WEIGHT = sheParams_->DISTANCE_WEIGHT;
+    DIRECTION_WEIGHT = sheParams_->DIRECTION_WEIGHT;
+    OTHER_ROBOT_WEIGHT = sheParams_->OTHER_ROBOT_WEIGHT;
+    DUPLICATE_COEFF = sheParams_->DUPLICATE_COEFF;
+    ON_MAP_COEFF = sheParams_->ON_MAP_COEFF;
+    LAST_GOAL_WEIGHT = sheParams_->LAST_GOAL_WEIGHT;
+    USE_ALLOCATED_GOAL = sheParams_->USE_ALLOCATED_GOAL;
+    ALLOCATED_GOAL_TIMEOUT = sheParams_->ALLOCATED_GOAL_TIMEOUT;
+    AF_BRANCH_AND_BOUND = sheParams_->AF_BRANCH_AND_BOUND;
+    AF_APPROXIMATION_TOLERANCE = sheParams_->AF_APPROXIMATION_TOLERANCE;
 }
 
 void SeamlessHybridExploration::outputParams(void){
@@ -489,4 +801,8 @@ void SeamlessHybridExploration::outputParams(void){
     ofs << "duplicate_coeff: " << DUPLICATE_COEFF << std::endl;
     ofs << "on_map_coeff: " << ON_MAP_COEFF << std::endl;
     ofs << "last_goal_weight: " << LAST_GOAL_WEIGHT << std::endl;
+    ofs << "use_allocated_goal: " << (USE_ALLOCATED_GOAL ? "true" : "false") << std::endl;
+    ofs << "allocated_goal_timeout: " << ALLOCATED_GOAL_TIMEOUT << std::endl;
+    ofs << "af_branch_and_bound: " << (AF_BRANCH_AND_BOUND ? "true" : "false") << std::endl;
+    ofs << "af_approximation_tolerance: " << AF_APPROXIMATION_TOLERANCE << std::endl;
  }
\ No newline at end of file
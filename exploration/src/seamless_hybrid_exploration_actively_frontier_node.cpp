@@ -13,8 +13,8 @@ int main(int argc, char* argv[]){
     // FrontierBasedExploration fbe;
     Movement mv;
 
-    ExpLib::Struct::subStruct<std_msgs::Bool> end("end",1);
-    ExpLib::Struct::subStruct<std_msgs::Bool> areaDiff("area_diff",1);
+    ExpLib::Struct::LatestValue<std_msgs::Bool> end("end",1);
+    ExpLib::Struct::LatestValue<std_msgs::Bool> areaDiff("area_diff",1);
 
     geometry_msgs::PointStamped goal;
     ros::NodeHandle p("~");
@@ -61,10 +61,10 @@ int main(int argc, char* argv[]){
     if(!DEBUG && ROTATION) mv.oneRotation();
 
     while(ros::ok()){
-        if(!areaDiff.q.callOne(ros::WallDuration(0.5)) && areaDiff.data.data) break;// ここに切り替え条件入れる
+        if(areaDiff.get() && areaDiff.get()->data) break;// ここに切り替え条件入れる
         branchTimer() && she.getGoal(goal) && !DEBUG ? mv.moveToGoal(goal) : ftdTimer() && !she.forwardTargetDetection() ? mv.halfRotation() : mv.moveToForward();
-        if(AUTO_FINISH && !end.q.callOne(ros::WallDuration(0.5)) && end.data.data) break;
-        ros::spinOnce();
+        if(AUTO_FINISH && end.get() && end.get()->data) break;
+        ExpLib::Struct::spinMainQueue();
     }
 
     ros::Time switchTime = ros::Time::now();
@@ -72,8 +72,9 @@ int main(int argc, char* argv[]){
 
     while(ros::ok()){
         if(she.getGoalAF(goal) && !DEBUG) mv.moveToGoal(goal,true);
-        if(AUTO_FINISH && !end.q.callOne(ros::WallDuration(0.5)) && end.data.data) break;
-        ros::spinOnce();
+        else ros::WallDuration(0.5).sleep(); // 入力を待たずに返るので, 目標が無い間に空回りしないようにする
+        if(AUTO_FINISH && end.get() && end.get()->data) break;
+        ExpLib::Struct::spinMainQueue();
     }
 
     ROS_INFO_STREAM("exploration finish !! -> time : " << ros::Duration(ros::Time::now()-start).toSec() << " [s]");
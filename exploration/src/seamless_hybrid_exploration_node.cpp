@@ -11,7 +11,7 @@ int main(int argc, char* argv[]){
     SeamlessHybridExploration she;
     Movement mv;
 
-    ExpLib::Struct::subStruct<std_msgs::Bool> end("end",1);
+    ExpLib::Struct::LatestValue<std_msgs::Bool> end("end",1);
 
     geometry_msgs::PointStamped goal;
     ros::NodeHandle p("~");
@@ -25,28 +25,20 @@ int main(int argc, char* argv[]){
     usleep(2e5);//timeがsim_timeに合うのを待つ
 
     ros::Time start = ros::Time::now();
-    ros::Time getGoalTime= ros::Time::now();
-
-    auto branchTimer = [&]{
-        if(DEBUG && std::abs(ros::Duration(ros::Time::now()-getGoalTime).toSec())>BRANCH_WAIT_TIME){
-            getGoalTime = ros::Time::now();
-            return true;
-        }
-        else if(ros::Duration(ros::Time::now()-getGoalTime).toSec()>BRANCH_WAIT_TIME){
-            getGoalTime = ros::Time::now();
-            return true;
-        }
-        return false;
-    };
 
     if(!DEBUG && ROTATION) mv.oneRotation();
 
+    // 目標は別のスレッドで branch_wait_time ごとに評価し直し, ここでは出来ている結果を待たずに取り出す
+    she.startGoalThread(BRANCH_WAIT_TIME);
+
     while(ros::ok()){
-        branchTimer() && she.getGoal(goal) && !DEBUG ? mv.moveToGoal(goal) : mv.moveToForward();
-        if(AUTO_FINISH && !end.q.callOne(ros::WallDuration(0.5)) && end.data.data) break;
-        ros::spinOnce();
+        she.latestGoal(goal) && !DEBUG ? mv.moveToGoal(goal) : mv.moveToForward();
+        if(AUTO_FINISH && end.get() && end.get()->data) break;
+        ExpLib::Struct::spinMainQueue();
     }
 
+    she.stopGoalThread();
+
     ROS_INFO_STREAM("exploration finish !! -> time : " << ros::Duration(ros::Time::now()-start).toSec() << " [s]");
 
     ros::shutdown();
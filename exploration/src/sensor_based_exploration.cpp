@@ -2,6 +2,7 @@
 #include <exploration_libraly/enum.h>
 #include <exploration_libraly/convert.h>
 #include <exploration_libraly/utility.h>
+#include <exploration_libraly/spatial_hash.h>
 #include <Eigen/Geometry>
 #include <fstream>
 #include <exploration_msgs/PointArray.h>
@@ -14,44 +15,64 @@
 #include <exploration_libraly/struct.h>
 #include <nav_msgs/OccupancyGrid.h>
 #include <nav_msgs/Path.h>
+#include <mutex>
 
 namespace ExStc = ExpLib::Struct;
 namespace ExCov = ExpLib::Convert;
 namespace ExEnm = ExpLib::Enum;
 namespace ExUtl = ExpLib::Utility;
 
+// dynamic_reconfigure のコールバックはメインスレッドで, 評価は goal のスレッドで動くので値はロックして受け渡す
+struct SensorBasedExploration::dynamicParams{
+    std::mutex mutex;
+    bool LAST_GOAL_EFFECT;
+    double LAST_GOAL_TOLERANCE;
+    bool CANCELED_GOAL_EFFECT;
+    double CANCELED_GOAL_TOLERANCE;
+};
+
 SensorBasedExploration::SensorBasedExploration()
     // :branch_(new ExStc::subStruct<exploration_msgs::PointArray>("branch", 1))
-    :branch_(new ExStc::subStruct<exploration_msgs::BranchArray>("branch", 1))
-    ,pose_(new ExStc::subStruct<geometry_msgs::PoseStamped>("pose", 1))
+    :branch_(new ExStc::LatestValue<exploration_msgs::BranchArray>("branch", 1))
+    ,pose_(new ExStc::LatestValue<geometry_msgs::PoseStamped>("pose", 1))
     // ,poseLog_(new ExStc::subStruct<exploration_msgs::PoseStampedArray>("pose_log", 1))
     // ,poseLog_(new ExStc::subStruct<nav_msgs::Path>("pose_log", 1))
-    ,canceled_(new ExStc::subStruct<exploration_msgs::PointArray>("canceled_goals", 1))
+    ,canceled_(new ExStc::LatestValue<exploration_msgs::PointArray>("canceled_goals", 1))
     // ,map_(new ExStc::subStruct<nav_msgs::OccupancyGrid>("map", 1))
     // ,dupBra_(new ExStc::pubStruct<exploration_msgs::PointArray>("duplicated_branch", 1, true))
     // ,onMapBra_(new ExStc::pubStruct<exploration_msgs::PointArray>("on_map_branch", 1, true))
     ,goal_(new ExStc::pubStruct<geometry_msgs::PointStamped>("goal", 1, true))
-    ,drs_(new dynamic_reconfigure::Server<exploration::sensor_based_exploration_parameter_reconfigureConfig>(ros::NodeHandle("~/sensor_based_exploration")))
-    ,lastGoal_(new geometry_msgs::Point()){
+    ,drs_(new dynamic_reconfigure::Server<exploration::sensor_based_exploration_parameter_reconfigureConfig>(ExStc::mainQueueHandle("~/sensor_based_exploration")))
+    ,lastGoal_(new geometry_msgs::Point())
+    ,canceledHash_(new ExpLib::SpatialHash())
+    ,sbeParams_(new dynamicParams()){
     loadParams();
     SensorBasedExploration::drs_->setCallback(boost::bind(&SensorBasedExploration::dynamicParamsCB,this, _1, _2));
 }
 
 SensorBasedExploration::~SensorBasedExploration(){
-    if(OUTPUT_SBE_PARAMETERS) outputParams();
+    if(OUTPUT_SBE_PARAMETERS){
+        syncParams();
+        outputParams();
+    }
 }
 
 bool SensorBasedExploration::getGoal(geometry_msgs::PointStamped& goal){
-    // 分岐の読み込み
+    // 評価の途中でパラメータが変わらないように最初に一度だけ写す
+    syncParams();
+
+    // 分岐の読み込み, 受け取り済みの最新の値を使うのでまだ一度も来ていない時だけ待つ
     // if(branch_->q.callOne(ros::WallDuration(1)) || branch_->data.points.size()==0){
-    if(branch_->q.callOne(ros::WallDuration(1)) || branch_->data.branches.size()==0){
-        ROS_ERROR_STREAM("Can't read branch or don't find branch");  
+    const exploration_msgs::BranchArrayConstPtr branch = branch_->waitFor(ros::WallDuration(1),BRANCH_MAX_AGE);
+    if(!branch || branch->branches.size()==0){
+        ROS_ERROR_STREAM("Can't read branch, branch is stale (age : " << branch_->age() << " s) or don't find branch");  
         return false;
     }
 
     // pose の読みこみ
-    if(pose_->q.callOne(ros::WallDuration(1))){
-        ROS_ERROR_STREAM("Can't read pose");
+    const geometry_msgs::PoseStampedConstPtr pose = pose_->waitFor(ros::WallDuration(1),POSE_MAX_AGE);
+    if(!pose){
+        ROS_ERROR_STREAM("Can't read pose or pose is stale (age : " << pose_->age() << " s)");
         return false;
     }
 
@@ -62,7 +83,7 @@ bool SensorBasedExploration::getGoal(geometry_msgs::PointStamped& goal){
     // }
 
     // std::vector<geometry_msgs::Point> branches(branch_->data.points);
-    exploration_msgs::BranchArray ba = branch_->data;
+    exploration_msgs::BranchArray ba = *branch;
 
     //　最後のゴールと近かったら削除
     // if(LAST_GOAL_EFFECT){
@@ -83,12 +104,11 @@ bool SensorBasedExploration::getGoal(geometry_msgs::PointStamped& goal){
     //     });
 	// 	branches.erase(std::move(removeResult),branches.end());
     // }
-    if(CANCELED_GOAL_EFFECT && !canceled_->q.callOne(ros::WallDuration(1)) && canceled_->data.points.size()!=0){
+    const exploration_msgs::PointArrayConstPtr canceled = canceled_->get();
+    if(CANCELED_GOAL_EFFECT && canceled && canceled->points.size()!=0){
+        canceledHash_->syncAppendOnly(canceled->points,CANCELED_GOAL_TOLERANCE);
         auto removeResult = std::remove_if(ba.branches.begin(),ba.branches.end(),[this](exploration_msgs::Branch& b){
-            for(const auto& c : canceled_->data.points){
-                if(Eigen::Vector2d(b.point.x - c.x, b.point.y - c.y).norm()<CANCELED_GOAL_TOLERANCE) return true;
-            }
-            return false;
+            return canceledHash_->contains(Eigen::Vector2d(b.point.x, b.point.y),CANCELED_GOAL_TOLERANCE);
         });
 		ba.branches.erase(std::move(removeResult),ba.branches.end());
     }
@@ -118,7 +138,23 @@ bool SensorBasedExploration::getGoal(geometry_msgs::PointStamped& goal){
 
     // goal を決定 // 適切なゴールが無ければ false
     // return decideGoal(goal, ls, pose_->data);
-    return decideGoal(goal, ba, pose_->data);
+    return decideGoal(goal, ba, *pose);
+}
+
+void SensorBasedExploration::storeParams(bool lastGoalEffect, double lastGoalTolerance, bool canceledGoalEffect, double canceledGoalTolerance){
+    std::lock_guard<std::mutex> lock(sbeParams_->mutex);
+    sbeParams_->LAST_GOAL_EFFECT = lastGoalEffect;
+    sbeParams_->LAST_GOAL_TOLERANCE = lastGoalTolerance;
+    sbeParams_->CANCELED_GOAL_EFFECT = canceledGoalEffect;
+    sbeParams_->CANCELED_GOAL_TOLERANCE = canceledGoalTolerance;
+}
+
+void SensorBasedExploration::syncParams(void){
+    std::lock_guard<std::mutex> lock(sbeParams_->mutex);
+    LAST_GOAL_EFFECT = sbeParams_->LAST_GOAL_EFFECT;
+    LAST_GOAL_TOLERANCE = sbeParams_->LAST_GOAL_TOLERANCE;
+    CANCELED_GOAL_EFFECT = sbeParams_->CANCELED_GOAL_EFFECT;
+    CANCELED_GOAL_TOLERANCE = sbeParams_->CANCELED_GOAL_TOLERANCE;
 }
 
 // void SensorBasedExploration::duplicateDetection(std::vector<ExStc::listStruct>& ls, const exploration_msgs::PoseStampedArray& log){
@@ -227,13 +263,14 @@ void SensorBasedExploration::loadParams(void){
     // static parameters
     nh.param<std::string>("sbe_parameter_file_path",SBE_PARAMETER_FILE_PATH,"sbe_last_parameters.yaml");
     nh.param<bool>("output_sbe_parameters",OUTPUT_SBE_PARAMETERS,true);
+    nh.param<double>("branch_max_age",BRANCH_MAX_AGE,2.0);
+    nh.param<double>("pose_max_age",POSE_MAX_AGE,2.0);
+
+    storeParams(LAST_GOAL_EFFECT, LAST_GOAL_TOLERANCE, CANCELED_GOAL_EFFECT, CANCELED_GOAL_TOLERANCE);
 }
 
 void SensorBasedExploration::dynamicParamsCB(exploration::sensor_based_exploration_parameter_reconfigureConfig &cfg, uint32_t level){
-    LAST_GOAL_EFFECT = cfg.last_goal_effect;
-    LAST_GOAL_TOLERANCE = cfg.last_goal_tolerance;
-    CANCELED_GOAL_EFFECT = cfg.canceled_goal_effect;
-    CANCELED_GOAL_TOLERANCE = cfg.canceled_goal_tolerance;
+    storeParams(cfg.last_goal_effect, cfg.last_goal_tolerance, cfg.canceled_goal_effect, cfg.canceled_goal_tolerance);
     // ON_MAP_BRANCH_DETECTION = cfg.on_map_branch_detection;
     // ON_MAP_BRANCH_RATE = cfg.on_map_branch_rate;
     // OMB_MAP_WINDOW_X = cfg.omb_map_window_x;
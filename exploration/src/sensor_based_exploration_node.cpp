@@ -11,7 +11,7 @@ int main(int argc, char *argv[]){
     SensorBasedExploration sbe;
     Movement mv;
 
-    ExpLib::Struct::subStruct<std_msgs::Bool> end("end",1);
+    ExpLib::Struct::LatestValue<std_msgs::Bool> end("end",1);
 
     geometry_msgs::PointStamped goal;
     ros::NodeHandle p("~");
@@ -39,8 +39,8 @@ int main(int argc, char *argv[]){
 
     while(ros::ok()){
         branchTimer() && sbe.getGoal(goal) && !DEBUG ? mv.moveToGoal(goal) : mv.moveToForward();
-        if(AUTO_FINISH && !end.q.callOne(ros::WallDuration(0.5)) && end.data.data) break;
-        ros::spinOnce();
+        if(AUTO_FINISH && end.get() && end.get()->data) break;
+        ExpLib::Struct::spinMainQueue();
     }
 
     ROS_INFO_STREAM("exploration finish !! -> time : " << ros::Duration(ros::Time::now()-start).toSec() << " [s]");
@@ -0,0 +1,15 @@
+#ifndef ASSIGNMENT_H
+#define ASSIGNMENT_H
+
+#include <Eigen/Core>
+#include <vector>
+
+namespace ExpLib{
+    namespace Assignment{
+        // cost (行 : 割り当てる側, 列 : 割り当て先) の合計が最小になる割り当てを Hungarian 法で求める
+        // 行ごとに割り当てた列を返す, 列が足りずに割り当てられなかった行は -1
+        std::vector<int> hungarian(const Eigen::MatrixXd& cost);
+    }
+}
+
+#endif // ASSIGNMENT_H
@@ -0,0 +1,37 @@
+#ifndef DISTANCE_FIELD_H
+#define DISTANCE_FIELD_H
+
+#include <Eigen/Core>
+#include <vector>
+
+namespace ExpLib{
+    class DistanceField{// 一つの起点から costmap 上の全てのセルへの最小コスト経路を Dijkstra で求める
+        private:
+            int width;
+            int height;
+            double resolution;
+            Eigen::Vector2d origin;
+            int source;
+            std::vector<float> cost; // 起点からの経路コスト, 未到達は FLT_MAX
+            std::vector<int> parent; // 経路上で一つ起点側のセル, 起点と未到達は -1
+            std::vector<std::pair<float,int>> heap; // 探索用, 容量を使いまわす
+
+            bool toIndex(const Eigen::Vector2d& p, int& index) const;
+            Eigen::Vector2d toPoint(int index) const;
+
+        public:
+            DistanceField();
+
+            // costs は costmap_2d の値 (row-major), 253 以上は通れない, 255 (未知) は allowUnknown なら通れるが 253 と同じコストにする (navfn の allow_unknown と同じ)
+            // 起点と targets のセルは通れなくても入れる (targets のセルから先へは広げない)
+            // targets を全て確定したら探索を打ち切る, 空なら地図全体を探索する
+            // 地図の外の targets は無視する, targets が全て無視されたら起点以外は未到達のまま返す
+            // 起点が地図の外なら false
+            bool compute(const unsigned char* costs, int width, int height, double resolution, const Eigen::Vector2d& origin, const Eigen::Vector2d& source, const std::vector<Eigen::Vector2d>& targets=std::vector<Eigen::Vector2d>(), bool allowUnknown=true);
+
+            // p から起点までの経路をセルの中心座標で返す (p 側が先頭), たどり着けなければ false
+            bool path(const Eigen::Vector2d& p, std::vector<Eigen::Vector2d>& points) const;
+    };
+}
+
+#endif // DISTANCE_FIELD_H
@@ -2,46 +2,314 @@
 #define PATH_PLANNING_H
 
 #include <costmap_2d/costmap_2d_ros.h>
+#include <exploration_libraly/distance_field.h>
+#include <exploration_libraly/struct.h>
+#include <exploration_libraly/thread_pool.h>
+#include <exploration_msgs/PathCacheStatus.h>
 #include <Eigen/Core>
 #include <geometry_msgs/PoseStamped.h>
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
 
 namespace ExpLib{
+    // 経路は costmap のスナップショット上で求める
+    // スナップショットは問い合わせの時に前のものが path_planning_snapshot_rate の周期より古ければ作り直す, 問い合わせが無い間はコピーしない
+    // 問い合わせはスナップショットと planner の組を借りて行うので複数のスレッドから同時に呼んで良い
+    // costmap_2d は層の購読を global queue に登録し, キューを指定できないので global queue をプロセスで共有するスレッドで回し続ける
+    // (メインスレッドが moveToGoal などで止まっていても costmap は更新される)
+    // 使う側のノードとの約束 :
+    //   global queue のコールバックはこのスレッドでメインスレッドと同時に呼ばれるので, ノード自身のコールバック (購読, タイマー, サービス, dynamic_reconfigure) は
+    //   Struct::mainQueueHandle で作った NodeHandle か自前のキューに登録し, global queue に登録しない
+    //   メインループでは ros::spinOnce の代わりに Struct::spinMainQueue を呼ぶ
     template<typename T>
     class PathPlanning{
         private:
             double PATH_TO_VECTOR_RATIO;
+            int PATH_CACHE_SIZE;
+            int PATH_CACHE_QUANTIZATION;
+            int PATH_PLANNING_THREADS;
+            double SNAPSHOT_RATE; // スナップショットを作り直す最大の頻度
+            bool ALLOW_UNKNOWN; // planner の allow_unknown, getDistanceField も同じにする
             tf::TransformListener tfl;
             costmap_2d::Costmap2DROS gcr;
-            T planner;
+            std::string plannerName;
+
+            // costmap のスナップショット, 作った後は書き換えずに差し替える
+            struct snapshotStruct{
+                costmap_2d::Costmap2D costmap;
+                uint64_t revision; // 作るたびに増やす番号
+            };
+            std::shared_ptr<const snapshotStruct> snapshot;
+            ros::WallTime snapshotTime; // snapshot を作った時刻
+            std::mutex snapshotMutex;
+
+            // planner とそれが見る costmap の組, 同時には一つのスレッドだけが使う
+            // planner は起点のセルを書き換えるので costmap はスナップショットのコピーを持つ
+            struct plannerSlot{
+                costmap_2d::Costmap2D costmap;
+                T planner;
+                uint64_t revision; // costmap にコピーしたスナップショットの番号
+            };
+            std::vector<std::unique_ptr<plannerSlot>> slots;
+            std::vector<plannerSlot*> freeSlots;
+            std::mutex slotMutex;
+            std::unique_ptr<ThreadPool> pool; // planBatch 用
+
+            // 経路のキャッシュ, 量子化した start, goal のセルで引く
+            struct cacheKey{
+                unsigned int sx, sy, gx, gy;
+                bool operator==(const cacheKey& k) const {return sx == k.sx && sy == k.sy && gx == k.gx && gy == k.gy;};
+            };
+            struct cacheKeyHash{
+                size_t operator()(const cacheKey& k) const {return (size_t(k.sx) * 73856093u) ^ (size_t(k.sy) * 19349663u) ^ (size_t(k.gx) * 83492791u) ^ (size_t(k.gy) * 2654435761u);};
+            };
+            struct cacheEntry{
+                cacheKey key;
+                std::vector<geometry_msgs::PoseStamped> plan;
+                std::vector<std::pair<unsigned int,unsigned char>> cells; // 経路が通るセルと計画した時のコスト
+            };
+            std::list<cacheEntry> cache; // 先頭ほど最近使ったもの
+            std::unordered_map<cacheKey,typename std::list<cacheEntry>::iterator,cacheKeyHash> cacheIndex;
+            std::mutex cacheMutex;
+            std::tuple<unsigned int,unsigned int,double,double,double> costmapGeometry; // 前回見た costmap の大きさ, 原点, 解像度
+            exploration_msgs::PathCacheStatus cacheStatus;
+            ros::Publisher cacheStatusPub;
+            ros::WallTime lastStatusPublish;
+
+            void initCache(const std::string& costmapName){
+                ros::NodeHandle nh("~");
+                nh.param<int>("path_cache_size", PATH_CACHE_SIZE, 256);
+                nh.param<int>("path_cache_quantization", PATH_CACHE_QUANTIZATION, 1);
+                PATH_CACHE_QUANTIZATION = std::max(1,PATH_CACHE_QUANTIZATION);
+                costmapGeometry = std::make_tuple(0u,0u,0.0,0.0,0.0);
+                cacheStatus.quantization = PATH_CACHE_QUANTIZATION;
+                cacheStatus.capacity = std::max(0,PATH_CACHE_SIZE);
+                cacheStatusPub = nh.advertise<exploration_msgs::PathCacheStatus>(costmapName + "/path_cache_status",1,true);
+            };
+
+            // costmap の大きさ, 原点, 解像度が変わったらセルの番号が変わるので全て捨てる (cacheMutex をロックして呼ぶ)
+            void updateRevision(const costmap_2d::Costmap2D& costmap){
+                const auto geometry = std::make_tuple(costmap.getSizeInCellsX(),costmap.getSizeInCellsY(),costmap.getOriginX(),costmap.getOriginY(),costmap.getResolution());
+                if(geometry == costmapGeometry) return;
+                costmapGeometry = geometry;
+                cache.clear();
+                cacheIndex.clear();
+                ++cacheStatus.revision;
+            };
+
+            // 計画した時から経路上のコストが変わっていなければ使える
+            bool isValid(const costmap_2d::Costmap2D& costmap, const cacheEntry& entry){
+                const unsigned char* chars = costmap.getCharMap();
+                for(const auto& c : entry.cells){
+                    if(chars[c.first] != c.second) return false;
+                }
+                return true;
+            };
+
+            void publishCacheStatus(void){
+                ros::WallTime now = ros::WallTime::now();
+                if((now - lastStatusPublish).toSec() < 1.0) return;
+                lastStatusPublish = now;
+                cacheStatus.header.stamp = ros::Time::now();
+                cacheStatus.size = cache.size();
+                cacheStatusPub.publish(cacheStatus);
+            };
+
+            // キャッシュを引く, 見つからなければ覚える時のキーを key に入れる (cacheMutex をロックして呼ぶ)
+            bool findCache(const costmap_2d::Costmap2D& costmap, const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal, cacheKey& key, bool& cacheable, std::vector<geometry_msgs::PoseStamped>& plan){
+                updateRevision(costmap);
+                // costmap の外は覚えずに planner に任せる
+                cacheable = costmap.worldToMap(start.pose.position.x,start.pose.position.y,key.sx,key.sy) && costmap.worldToMap(goal.pose.position.x,goal.pose.position.y,key.gx,key.gy);
+                if(cacheable){
+                    key.sx /= PATH_CACHE_QUANTIZATION;
+                    key.sy /= PATH_CACHE_QUANTIZATION;
+                    key.gx /= PATH_CACHE_QUANTIZATION;
+                    key.gy /= PATH_CACHE_QUANTIZATION;
+
+                    auto it = cacheIndex.find(key);
+                    if(it != cacheIndex.end()){
+                        if(isValid(costmap,*it->second)){
+                            cache.splice(cache.begin(),cache,it->second);
+                            plan = it->second->plan;
+                            ++cacheStatus.hits;
+                            return true;
+                        }
+                        cache.erase(it->second);
+                        cacheIndex.erase(it);
+                        ++cacheStatus.invalidations;
+                    }
+                }
+                ++cacheStatus.misses;
+                return false;
+            };
+
+            // costmap で求めた経路を覚える (cacheMutex をロックして呼ぶ)
+            void storeCache(const costmap_2d::Costmap2D& costmap, const cacheKey& key, const std::vector<geometry_msgs::PoseStamped>& plan){
+                updateRevision(costmap);
+                cacheEntry entry;
+                entry.key = key;
+                entry.plan = plan;
+                const unsigned char* chars = costmap.getCharMap();
+                entry.cells.reserve(plan.size());
+                for(const auto& p : plan){
+                    unsigned int mx, my;
+                    if(!costmap.worldToMap(p.pose.position.x,p.pose.position.y,mx,my)) continue;
+                    const unsigned int index = costmap.getIndex(mx,my);
+                    if(entry.cells.empty() || entry.cells.back().first != index) entry.cells.emplace_back(index,chars[index]);
+                }
+                auto it = cacheIndex.find(key);
+                if(it != cacheIndex.end()){
+                    cache.erase(it->second);
+                    cacheIndex.erase(it);
+                }
+                cache.emplace_front(std::move(entry));
+                cacheIndex[key] = cache.begin();
+                while((int)cache.size() > PATH_CACHE_SIZE){
+                    cacheIndex.erase(cache.back().key);
+                    cache.pop_back();
+                    ++cacheStatus.evictions;
+                }
+            };
+
+            // 前のスナップショットが SNAPSHOT_RATE の周期より古ければ costmap をコピーして作り直す
+            // 同時に呼ばれても作り直すのは一つのスレッドだけで, 他のスレッドは出来上がったものを使う
+            std::shared_ptr<const snapshotStruct> currentSnapshot(void){
+                std::lock_guard<std::mutex> lock(snapshotMutex);
+                const ros::WallTime now = ros::WallTime::now();
+                if(snapshot && (now - snapshotTime).toSec() < 1.0/std::max(SNAPSHOT_RATE,1e-3)) return snapshot;
+                std::shared_ptr<snapshotStruct> next(new snapshotStruct());
+                {
+                    costmap_2d::Costmap2D* costmap = gcr.getCostmap();
+                    boost::unique_lock<costmap_2d::Costmap2D::mutex_t> cLock(*(costmap->getMutex()));
+                    next->costmap = *costmap;
+                }
+                next->revision = snapshot ? snapshot->revision + 1 : 0;
+                snapshot = next;
+                snapshotTime = now;
+                return snapshot;
+            };
+
+            // 空いている planner を借りる, 無ければ元の planner と同じパラメータで作る
+            plannerSlot* acquireSlot(const snapshotStruct& s){
+                plannerSlot* slot;
+                {
+                    std::lock_guard<std::mutex> lock(slotMutex);
+                    if(freeSlots.empty()){
+                        // 最初の一つは元の名前, 二つ目からは元のパラメータをコピーした名前で初期化する
+                        std::string name = plannerName;
+                        if(!slots.empty()){
+                            name = plannerName + "_batch" + std::to_string(slots.size());
+                            ros::NodeHandle nh("~");
+                            XmlRpc::XmlRpcValue params;
+                            if(nh.getParam(plannerName, params)) nh.setParam(name, params);
+                        }
+                        slots.emplace_back(new plannerSlot());
+                        slot = slots.back().get();
+                        slot->costmap = s.costmap;
+                        slot->revision = s.revision;
+                        slot->planner.initialize(name,&slot->costmap,gcr.getGlobalFrameID());
+                        return slot;
+                    }
+                    slot = freeSlots.back();
+                    freeSlots.pop_back();
+                }
+                if(slot->revision != s.revision){
+                    slot->costmap = s.costmap;
+                    slot->revision = s.revision;
+                }
+                return slot;
+            };
+
+            void releaseSlot(plannerSlot* slot){
+                std::lock_guard<std::mutex> lock(slotMutex);
+                freeSlots.emplace_back(slot);
+            };
+
+            bool planOnSlot(plannerSlot& slot, const snapshotStruct& s, const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal, std::vector<geometry_msgs::PoseStamped>& plan){
+                const bool success = slot.planner.makePlan(start,goal,plan) && !plan.empty();
+                // planner が空けた起点のセルを元に戻す
+                unsigned int mx, my;
+                if(slot.costmap.worldToMap(start.pose.position.x,start.pose.position.y,mx,my)) slot.costmap.setCost(mx,my,s.costmap.getCost(mx,my));
+                return success;
+            };
+
+            bool makePlan(const snapshotStruct& s, const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal, std::vector<geometry_msgs::PoseStamped>& plan){
+                plannerSlot* slot = acquireSlot(s);
+                const bool success = planOnSlot(*slot,s,start,goal,plan);
+                releaseSlot(slot);
+                return success;
+            };
+
+            bool makePlan(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal, std::vector<geometry_msgs::PoseStamped>& plan){
+                const std::shared_ptr<const snapshotStruct> s = currentSnapshot();
+                if(PATH_CACHE_SIZE <= 0) return makePlan(*s,start,goal,plan);
+
+                cacheKey key;
+                bool cacheable;
+                {
+                    std::lock_guard<std::mutex> cLock(cacheMutex);
+                    if(findCache(s->costmap,start,goal,key,cacheable,plan)){
+                        publishCacheStatus();
+                        return true;
+                    }
+                }
+
+                // 失敗した経路は costmap のどこが変わっても結果が変わりうるので覚えない
+                if(!makePlan(*s,start,goal,plan)) return false;
+                if(!cacheable) return true;
+
+                std::lock_guard<std::mutex> cLock(cacheMutex);
+                storeCache(s->costmap,key,plan);
+                publishCacheStatus();
+                return true;
+            };
+
+            std::shared_ptr<ros::AsyncSpinner> globalSpinner; // costmap_2d の購読用
+
+            void init(const std::string& costmapName){
+                ros::NodeHandle nh("~");
+                nh.param<int>("path_planning_threads", PATH_PLANNING_THREADS, 0);
+                nh.param<double>("path_planning_snapshot_rate", SNAPSHOT_RATE, 5.0);
+                nh.param<bool>(plannerName + "/allow_unknown", ALLOW_UNKNOWN, true);
+                initCache(costmapName);
+                pool.reset(new ThreadPool(PATH_PLANNING_THREADS));
+                releaseSlot(acquireSlot(*currentSnapshot()));
+                globalSpinner = Struct::sharedSpinner(ros::getGlobalCallbackQueue());
+            };
 
         public:
-            PathPlanning():tfl(ros::Duration(10)),gcr("costmap", tfl){
+            PathPlanning():tfl(ros::Duration(10)),gcr("costmap", tfl),plannerName("path_planner"){
                 ros::NodeHandle("~").param<double>("path_to_vector_ratio", PATH_TO_VECTOR_RATIO, 0.8);
-                planner.initialize("path_planner",&gcr);
-                ros::spinOnce();
+                init("costmap");
             };
             
-            PathPlanning(const std::string& costmapName, const std::string& plannerName):tfl(ros::Duration(10)),gcr(costmapName, tfl){
+            PathPlanning(const std::string& costmapName, const std::string& plannerName):tfl(ros::Duration(10)),gcr(costmapName, tfl),plannerName(plannerName){
                 ros::NodeHandle("~").param<double>("path_to_vector_ratio", PATH_TO_VECTOR_RATIO, 0.5);
-                planner.initialize(plannerName,&gcr);
-                ros::spinOnce();
+                init(costmapName);
             };
 
             bool createPath(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal){
-                ros::spinOnce();
                 std::vector<geometry_msgs::PoseStamped> plan;
-                return planner.makePlan(start,goal,plan);
+                return makePlan(start,goal,plan);
             };
 
             bool createPath(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal, std::vector<geometry_msgs::PoseStamped>& plan){
-                ros::spinOnce();
-                return planner.makePlan(start,goal,plan);
+                return makePlan(start,goal,plan);
             };
 
             bool createPath(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal, std::vector<geometry_msgs::PoseStamped>& plan, nav_msgs::OccupancyGrid& map){//only voronoi
-                ros::spinOnce();
-                return planner.makePlan(start,goal,plan,map);
+                const std::shared_ptr<const snapshotStruct> s = currentSnapshot();
+                plannerSlot* slot = acquireSlot(*s);
+                const bool success = slot->planner.makePlan(start,goal,plan,map);
+                unsigned int mx, my;
+                if(slot->costmap.worldToMap(start.pose.position.x,start.pose.position.y,mx,my)) slot->costmap.setCost(mx,my,s->costmap.getCost(mx,my));
+                releaseSlot(slot);
+                return success;
             };
 
             void getDistance(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal, double& distance, std::vector<geometry_msgs::PoseStamped>& plan){
@@ -50,9 +318,8 @@ namespace ExpLib{
             }
 
             bool getDistance(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal, double& distance){
-                ros::spinOnce();
                 std::vector<geometry_msgs::PoseStamped> plan;
-                if(planner.makePlan(start,goal,plan)){
+                if(makePlan(start,goal,plan)){
                     getDistance(start, goal, distance, plan);
                     return true;
                 }
@@ -67,9 +334,8 @@ namespace ExpLib{
             };
 
             bool getVec(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal, Eigen::Vector2d& vec){
-                ros::spinOnce();
                 std::vector<geometry_msgs::PoseStamped> plan;
-                if(planner.makePlan(start,goal,plan)){
+                if(makePlan(start,goal,plan)){
                     getVec(start,goal,vec,plan);
                     return true;
                 }
@@ -77,9 +343,8 @@ namespace ExpLib{
             };
 
             bool getVecInit(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal, Eigen::Vector2d& vec){
-                ros::spinOnce();
                 std::vector<geometry_msgs::PoseStamped> plan;
-                if(planner.makePlan(start,goal,plan)){
+                if(makePlan(start,goal,plan)){
                     getVec(start,goal,vec,plan,true);
                     return true;
                 }
@@ -88,15 +353,103 @@ namespace ExpLib{
 
 
             bool getDistanceAndVec(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal, double& distance, Eigen::Vector2d& vec){
-                ros::spinOnce();
                 std::vector<geometry_msgs::PoseStamped> plan;
-                if(planner.makePlan(start,goal,plan)){
+                if(makePlan(start,goal,plan)){
                     getDistance(start,goal,distance,plan);
                     getVec(start,goal,vec,plan);
                     return true;
                 }
                 return false;
             };
+
+            // planBatch で同時に求める経路の数
+            int getThreads(void) const {
+                return pool->size();
+            };
+
+            struct planResult{
+                bool success;
+                double distance;
+                Eigen::Vector2d vec; // getVec と同じ経路の終わりの向き
+                std::vector<geometry_msgs::PoseStamped> plan; // keepPlan の時だけ入れる
+                planResult():success(false),distance(0),vec(0,0){};
+            };
+
+            // 独立な経路をまとめて求める, 全ての経路を同じスナップショットで求める
+            // キャッシュに無いものはスレッドごとに planner を借りて並列に求める
+            std::vector<planResult> planBatch(const std::vector<std::pair<geometry_msgs::PoseStamped,geometry_msgs::PoseStamped>>& queries, bool keepPlan=false){
+                std::vector<planResult> results(queries.size());
+                if(queries.empty()) return results;
+
+                const std::shared_ptr<const snapshotStruct> s = currentSnapshot();
+                std::vector<std::vector<geometry_msgs::PoseStamped>> plans(queries.size());
+                std::vector<cacheKey> keys(queries.size());
+                std::vector<char> cacheable(queries.size(),0);
+                std::vector<int> misses;
+                misses.reserve(queries.size());
+                if(PATH_CACHE_SIZE > 0){
+                    std::lock_guard<std::mutex> cLock(cacheMutex);
+                    for(int i=0,ie=queries.size();i!=ie;++i){
+                        bool c;
+                        if(findCache(s->costmap,queries[i].first,queries[i].second,keys[i],c,plans[i])) results[i].success = true;
+                        else misses.emplace_back(i);
+                        cacheable[i] = c;
+                    }
+                }
+                else for(int i=0,ie=queries.size();i!=ie;++i) misses.emplace_back(i);
+
+                if(!misses.empty()){
+                    const int threads = std::min<int>(pool->size(), misses.size());
+                    pool->parallelFor(0, threads, [&](int t){
+                        plannerSlot* slot = acquireSlot(*s);
+                        for(int k=t,ke=misses.size();k<ke;k+=threads){
+                            const int i = misses[k];
+                            results[i].success = planOnSlot(*slot,*s,queries[i].first,queries[i].second,plans[i]);
+                        }
+                        releaseSlot(slot);
+                    });
+                }
+
+                if(PATH_CACHE_SIZE > 0){
+                    std::lock_guard<std::mutex> cLock(cacheMutex);
+                    for(const auto& i : misses){
+                        if(results[i].success && cacheable[i]) storeCache(s->costmap,keys[i],plans[i]);
+                    }
+                    publishCacheStatus();
+                }
+
+                for(int i=0,ie=queries.size();i!=ie;++i){
+                    if(!results[i].success) continue;
+                    getDistance(queries[i].first,queries[i].second,results[i].distance,plans[i]);
+                    getVec(queries[i].first,queries[i].second,results[i].vec,plans[i]);
+                    if(keepPlan) results[i].plan.swap(plans[i]);
+                }
+                return results;
+            };
+
+            // source から costmap 全体への距離場を作る, 同じ起点から何度も経路を求める時は makePlan の代わりにこちらを使う
+            // 未知のセルを通るかは planner の allow_unknown に合わせる
+            bool getDistanceField(const geometry_msgs::Point& source, const std::vector<geometry_msgs::Point>& targets, DistanceField& field){
+                std::vector<Eigen::Vector2d> t;
+                t.reserve(targets.size());
+                for(const auto& p : targets) t.emplace_back(p.x,p.y);
+                const std::shared_ptr<const snapshotStruct> s = currentSnapshot();
+                const costmap_2d::Costmap2D& costmap = s->costmap;
+                return field.compute(costmap.getCharMap(),costmap.getSizeInCellsX(),costmap.getSizeInCellsY(),costmap.getResolution(),Eigen::Vector2d(costmap.getOriginX(),costmap.getOriginY()),Eigen::Vector2d(source.x,source.y),t,ALLOW_UNKNOWN);
+            };
+
+            // field の起点から goal までの距離と経路の終わりの向き, reverse なら goal から field の起点まで
+            bool getDistanceAndVec(const DistanceField& field, const geometry_msgs::Point& goal, double& distance, Eigen::Vector2d& vec, bool reverse=false){
+                std::vector<Eigen::Vector2d> plan;
+                if(!field.path(Eigen::Vector2d(goal.x,goal.y),plan) || plan.size() < 2) return false;
+                if(!reverse) std::reverse(plan.begin(),plan.end());
+                distance = 0;
+                for(int i=1,ie=plan.size();i!=ie;++i) distance += (plan[i] - plan[i-1]).norm();
+                int b = plan.size() - 1;
+                int a = b * PATH_TO_VECTOR_RATIO;
+                vec = (plan[b] - plan[a]).normalized();
+                return true;
+            };
     };
 }
 
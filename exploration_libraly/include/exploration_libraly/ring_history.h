@@ -0,0 +1,86 @@
+#ifndef RING_HISTORY_H
+#define RING_HISTORY_H
+
+#include <algorithm>
+#include <vector>
+
+namespace ExpLib{
+    template <typename T>
+    class RingHistory{// 時刻付きの値を最大 capacity 個, 最新から horizon 秒以内だけ持つ履歴, 領域は最初に確保して使いまわす
+        private:
+            int cap;
+            double horizon; // 0 以下なら時間では捨てない
+            std::vector<T> values;
+            std::vector<double> stamps;
+            int head; // 次に書き込む位置
+            int count;
+
+            int position(int age) const {
+                return (head - 1 - age + cap) % cap;
+            };
+
+        public:
+            explicit RingHistory(int capacity=1, double horizon=0):cap(0),horizon(0),head(0),count(0){
+                reset(capacity,horizon);
+            };
+
+            // 空にして容量と保持時間を変える
+            void reset(int capacity, double horizon){
+                cap = std::max(1,capacity);
+                this->horizon = horizon;
+                values.assign(cap,T());
+                stamps.assign(cap,0);
+                head = 0;
+                count = 0;
+            };
+            void clear(void){
+                head = 0;
+                count = 0;
+            };
+            // 一番古い値の場所を空けて返すので中身を書き込む, 代入すれば前の値の領域 (vector の容量など) を使いまわせる
+            // stamp より horizon 秒以上古い値はここで捨てる
+            T& push(double stamp){
+                while(horizon > 0 && count > 0 && stamp - stamps[position(count-1)] > horizon) --count;
+                const int p = head;
+                stamps[p] = stamp;
+                head = (head + 1) % cap;
+                if(count < cap) ++count;
+                return values[p];
+            };
+            void push(double stamp, const T& value){
+                push(stamp) = value;
+            };
+            int size(void) const {
+                return count;
+            };
+            int capacity(void) const {
+                return cap;
+            };
+            double getHorizon(void) const {
+                return horizon;
+            };
+            bool empty(void) const {
+                return count == 0;
+            };
+            // age 個前の値, 0 が最新
+            const T& at(int age) const {
+                return values[position(age)];
+            };
+            double stamp(int age) const {
+                return stamps[position(age)];
+            };
+            // 最新の値から window 秒以内の値を新しい順に f(value, stamp) に渡す, window が 0 以下なら全部
+            template <typename F>
+            void forEachWithin(double window, F f) const {
+                if(count == 0) return;
+                const double latest = stamps[position(0)];
+                for(int i=0;i!=count;++i){
+                    const int p = position(i);
+                    if(window > 0 && latest - stamps[p] > window) break;
+                    f(values[p],stamps[p]);
+                }
+            };
+    };
+}
+
+#endif // RING_HISTORY_H
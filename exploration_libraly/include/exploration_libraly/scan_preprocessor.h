@@ -0,0 +1,53 @@
+#ifndef SCAN_PREPROCESSOR_H
+#define SCAN_PREPROCESSOR_H
+
+#include <limits>
+#include <memory>
+#include <vector>
+
+// 前方宣言
+
+/// my packages
+namespace ExpLib{
+    namespace Struct{
+        struct scanStruct;
+    }
+}
+/// rosmsgs
+namespace sensor_msgs{
+    template <class ContainerAllocator>
+    struct LaserScan_;
+    typedef ::sensor_msgs::LaserScan_<std::allocator<void>> LaserScan;
+}
+// 前方宣言 ここまで
+
+namespace ExpLib{
+    class ScanPreprocessor{// 各ビームの角度と sin, cos を表にして持ち, 設定 (angle_min, angle_increment, ビーム数) が同じスキャンでは作り直さない
+        private:
+            float angleMin;
+            float angleIncrement;
+            int count;
+            std::vector<float> angles;
+            std::vector<float> cosTable;
+            std::vector<float> sinTable;
+            std::vector<float> xs; // toScanStruct 用, 全ビームの x, y
+            std::vector<float> ys;
+
+        public:
+            ScanPreprocessor();
+
+            // scan の設定が前と違えば表を作り直す
+            void prepare(const sensor_msgs::LaserScan& scan);
+            // prepare した設定の表, 添字はビームの番号
+            const std::vector<float>& getAngles(void) const;
+            const std::vector<float>& getCos(void) const;
+            const std::vector<float>& getSin(void) const;
+
+            // 前方向の距離 ranges[i] * cos, nan は nan のまま
+            void forwardRanges(const sensor_msgs::LaserScan& scan, std::vector<float>& out);
+            // nan と x が xMax より大きいビームを除いて距離, 角度, x, y を ss に入れる
+            void toScanStruct(const sensor_msgs::LaserScan& scan, Struct::scanStruct& ss, float xMax=std::numeric_limits<float>::infinity());
+    };
+}
+
+#endif // SCAN_PREPROCESSOR_H
@@ -0,0 +1,49 @@
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace ExpLib{
+    class SpatialHash{// 2次元の点を正方形のセルに分けて持ち, 半径内の点を近くのセルだけから探す
+        private:
+            double cellSize;
+            std::vector<Eigen::Vector2d> points;
+            std::unordered_map<uint64_t,std::vector<int>> cells; // セル -> 点番号
+
+            int64_t toCell(double v) const;
+            static uint64_t key(int64_t x, int64_t y);
+
+        public:
+            explicit SpatialHash(double cellSize=1.0);
+
+            // 空にしてセルの一辺の長さを変える, 探す半径と同じくらいにすると速い
+            void reset(double cellSize);
+            void clear(void);
+            void insert(const Eigen::Vector2d& p);
+            int size(void) const;
+            double getCellSize(void) const;
+            const Eigen::Vector2d& point(int index) const;
+
+            // p からの距離が radius 未満の点があるか
+            bool contains(const Eigen::Vector2d& p, double radius) const;
+            // p からの距離が radius 未満の点の番号 (insert した順) を返す
+            void radiusSearch(const Eigen::Vector2d& p, double radius, std::vector<int>& indices) const;
+
+            // 後ろに追加されていくだけの点列 (x, y を持つ msg) に合わせる, 増えた分だけを入れる
+            // 点列が減っていた時 (送り元が再起動した時など) とセルの一辺が変わった時は作り直す
+            template<typename T>
+            void syncAppendOnly(const std::vector<T>& source, double size);
+    };
+
+    template<typename T>
+    void SpatialHash::syncAppendOnly(const std::vector<T>& source, double size){
+        if(cellSize != (size > 0 ? size : 1.0)) reset(size);
+        else if(source.size() < points.size()) clear();
+        for(int i=points.size(),ie=source.size();i<ie;++i) insert(Eigen::Vector2d(source[i].x,source[i].y));
+    }
+}
+
+#endif // SPATIAL_HASH_H
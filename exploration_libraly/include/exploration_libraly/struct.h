@@ -5,6 +5,12 @@
 #include <ros/callback_queue.h>
 #include <exploration_libraly/enum.h>
 #include <geometry_msgs/Point.h>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 
 // 前方宣言
@@ -14,11 +20,27 @@ namespace nav_msgs{
     template <class ContainerAllocator>
     struct MapMetaData_;
     typedef ::nav_msgs::MapMetaData_<std::allocator<void>> MapMetaData;
+    template <class ContainerAllocator>
+    struct OccupancyGrid_;
+    typedef ::nav_msgs::OccupancyGrid_<std::allocator<void>> OccupancyGrid;
+    typedef boost::shared_ptr< ::nav_msgs::OccupancyGrid> OccupancyGridPtr;
+    typedef boost::shared_ptr< ::nav_msgs::OccupancyGrid const> OccupancyGridConstPtr;
 }
 // 前方宣言 ここまで
 
 namespace ExpLib{
     namespace Struct{
+        // queue を一つのスレッドで回し続ける AsyncSpinner をプロセスで共有する, 持っている側が全て無くなったら止まる
+        std::shared_ptr<ros::AsyncSpinner> sharedSpinner(ros::CallbackQueue* queue);
+        // ノードのメインスレッドで呼ぶコールバック (dynamic_reconfigure, ノードの処理が読む購読など) 用のキュー
+        // PathPlanning は costmap_2d のために global queue を別スレッドで回すので, それを使うノードのコールバックはこのキューに登録し,
+        // メインループでは ros::spinOnce の代わりに spinMainQueue を呼ぶ
+        ros::CallbackQueue& mainQueue(void);
+        ros::NodeHandle mainQueueHandle(const std::string& ns=std::string());
+        void spinMainQueue(void);
+        // LatestValue が共有するキュー, sharedSpinner の一つのスレッドで全ての LatestValue のコールバックを呼ぶ
+        ros::CallbackQueue& latestValueQueue(void);
+
         template <typename T>
         struct subStruct{
             ros::NodeHandle n;
@@ -36,6 +58,74 @@ namespace ExpLib{
                 sub = n.subscribe(topic,queue_size,fp,obj);
             };
         };
+        template <typename T>
+        class LatestValue{// 最新のメッセージをコピーせずに持つ, 共有のキューを別スレッドで回すので読む側は待たずに取り出せる
+            private:
+                ros::NodeHandle n;
+                ros::Subscriber sub;
+                std::shared_ptr<ros::AsyncSpinner> spinner;
+                mutable std::mutex mutex;
+                std::condition_variable cv;
+                boost::shared_ptr<const T> msg;
+                ros::WallTime received; // msg を受け取った時刻
+                bool unread; // getNew でまだ取り出していない
+
+            public:
+                LatestValue(const std::string& topic,uint32_t queue_size=1):unread(false){
+                    n.setCallbackQueue(&latestValueQueue());
+                    sub = n.subscribe<T>(topic, queue_size, [this](const boost::shared_ptr<const T>& m){
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            msg = m;
+                            received = ros::WallTime::now();
+                            unread = true;
+                        }
+                        cv.notify_all();
+                    });
+                    spinner = sharedSpinner(&latestValueQueue());
+                };
+                ~LatestValue(){
+                    // shutdown は実行中のコールバックを待つので, 以降 this には触れない
+                    sub.shutdown();
+                };
+                // 最新の値, まだ受け取っていなければ空
+                boost::shared_ptr<const T> get(void) const {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    return msg;
+                };
+                // 前に getNew で取り出してから新しく受け取った値, 無ければ空 (イベントを一度だけ処理する時に使う)
+                boost::shared_ptr<const T> getNew(void){
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if(!unread) return boost::shared_ptr<const T>();
+                    unread = false;
+                    return msg;
+                };
+                // 最新の値を受け取ってからの秒数, まだ受け取っていなければ負
+                double age(void) const {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    return msg ? (ros::WallTime::now() - received).toSec() : -1.0;
+                };
+                // maxAge 秒以内に受け取った最新の値, それより古ければ空
+                boost::shared_ptr<const T> get(double maxAge) const {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    return msg && (ros::WallTime::now() - received).toSec() <= maxAge ? msg : boost::shared_ptr<const T>();
+                };
+                // 値があればすぐに返し, 無ければ timeout まで待つ, 待っても来なければ空
+                // maxAge が正なら maxAge 秒以内に受け取った値だけを使う, 古い値しか無ければ新しい値を待ち, 来なければ空 (送り元が止まった時に古い値で動かない)
+                boost::shared_ptr<const T> waitFor(const ros::WallDuration& timeout, double maxAge=0){
+                    std::unique_lock<std::mutex> lock(mutex);
+                    auto fresh = [this,maxAge]{return msg != nullptr && (maxAge <= 0 || (ros::WallTime::now() - received).toSec() <= maxAge);};
+                    cv.wait_for(lock, std::chrono::nanoseconds(timeout.toNSec()), [this,&fresh]{return fresh() || !ros::ok();});
+                    return fresh() ? msg : boost::shared_ptr<const T>();
+                };
+                // 今持っている値より新しい値が来るまで timeout まで待つ (動いている間の姿勢を追う時など), 来なければ空
+                boost::shared_ptr<const T> waitForNext(const ros::WallDuration& timeout){
+                    std::unique_lock<std::mutex> lock(mutex);
+                    const boost::shared_ptr<const T> current = msg;
+                    if(!cv.wait_for(lock, std::chrono::nanoseconds(timeout.toNSec()), [this,&current]{return msg != current || !ros::ok();})) return boost::shared_ptr<const T>();
+                    return msg != current ? msg : boost::shared_ptr<const T>();
+                };
+        };
         struct subStructSimple{
             ros::NodeHandle n;
             ros::Subscriber sub;
@@ -80,6 +170,40 @@ namespace ExpLib{
             listStruct();
             listStruct(const geometry_msgs::Point& p);
         };
+        template <typename T>
+        struct GridView{// row-major の一次元配列をコピーせずに (x,y) で参照する, 要素番号は y*width+x
+            boost::shared_ptr<const void> owner; // 参照先の寿命を保つためのポインタ, 空なら参照先の寿命は呼び出し側が保証する
+            T* data;
+            int width;
+            int height;
+
+            GridView():data(nullptr),width(0),height(0){};
+            GridView(T* d, int w, int h, const boost::shared_ptr<const void>& o=boost::shared_ptr<const void>()):owner(o),data(d),width(w),height(h){};
+            GridView(int w, int h, typename std::remove_const<T>::type init){// 新しく配列を確保する
+                boost::shared_ptr<std::vector<typename std::remove_const<T>::type>> v(new std::vector<typename std::remove_const<T>::type>(w*h,init));
+                owner = v;
+                data = v->data();
+                width = w;
+                height = h;
+            };
+            template <typename U, typename = typename std::enable_if<std::is_convertible<U*,T*>::value>::type>
+            GridView(const GridView<U>& g):owner(g.owner),data(g.data),width(g.width),height(g.height){};// GridView<int8_t> -> GridView<const int8_t>
+
+            bool inside(int x, int y) const {return 0 <= x && x < width && 0 <= y && y < height;};
+            int index(int x, int y) const {return y*width+x;};
+            int size(void) const {return width*height;};
+            bool empty(void) const {return data == nullptr;};
+            T& operator()(int x, int y) const {return data[y*width+x];};// 範囲チェックなし
+            T& at(int x, int y) const {// 範囲チェックあり
+                if(!inside(x,y)) throw std::out_of_range("GridView::at : (" + std::to_string(x) + "," + std::to_string(y) + ") is out of " + std::to_string(width) + "x" + std::to_string(height));
+                return data[y*width+x];
+            };
+            T* row(int y) const {return data+y*width;};// y 行目の先頭
+            T* rowEnd(int y) const {return data+(y+1)*width;};// y 行目の末尾の次
+            T* begin(void) const {return data;};
+            T* end(void) const {return data+width*height;};
+        };
+        struct mapIntegral;
         struct mapSearchWindow{// 中心の座標, マップの大きさ, 窓の大きさを引数に取って　窓の上下左右の要素番号を返す
             int width;
             int height;
@@ -91,7 +215,30 @@ namespace ExpLib{
             mapSearchWindow(const geometry_msgs::Point& cc, const nav_msgs::MapMetaData& info, double lx, double ly=0.0); // cc : 検索窓の中心座標, info : 地図のメタデータ, lx,ly : 検索窓の辺の長さ(m)
             mapSearchWindow(const int cx, const int cy, const int mx, const int my, int lx, int ly=0); // cx,cy : 検索窓の中心の二次元配列インデックス, mx,my : 地図の辺の長さ(cell), lx,ly : 検索窓の辺の長さ(cell)
             void calcWindowSize(const int cx, const int cy, const int mx, const int my, const int lx, const int ly);
+            int area(void) const {return width*height;};
+            int knownCount(const GridView<const int8_t>& map) const; // 窓の中の既知セル(v >= 0)の数を一つずつ数える
+            int occupiedCount(const GridView<const int8_t>& map) const; // 窓の中の障害物セル(v == 100)の数を一つずつ数える
+            int knownCount(const mapIntegral& mi) const; // 積分画像から O(1) で求める
+            int occupiedCount(const mapIntegral& mi) const;
+        };
+        struct mapIntegral{// 地図の既知セルと障害物セルの積分画像(summed-area table), 任意の矩形内の個数を O(1) で求める
+            int width;
+            int height;
+            std::vector<uint32_t> known; // (width+1)*(height+1), known[y*(width+1)+x] は [0,x)x[0,y) の既知セルの数
+            std::vector<uint32_t> occupied;
+
+            mapIntegral();
+            mapIntegral(const GridView<const int8_t>& map);
+            bool empty(void) const {return known.empty();};
+            void clear(void);
+            int knownCount(int left, int top, int right, int bottom) const; // 両端を含む
+            int occupiedCount(int left, int top, int right, int bottom) const;
+            // 窓の数 * 窓の大きさが地図の大きさを超えるなら一つずつ数えるより積分画像を作ったほうが速い
+            static bool worthBuilding(long queries, long windowCells, long mapCells){return queries * windowCells > mapCells;};
         };
+        GridView<const int8_t> gridView(const nav_msgs::OccupancyGrid& m);// m の寿命は呼び出し側が保証する
+        GridView<const int8_t> gridView(const nav_msgs::OccupancyGridConstPtr& m);// m を保持する
+        GridView<int8_t> gridView(const nav_msgs::OccupancyGridPtr& m);// m を保持する, 書き換え可
     }
 }
 #endif // STRUCT_H
\ No newline at end of file
@@ -0,0 +1,65 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ExpLib{
+    class ThreadPool{// 固定数のワーカースレッドで処理を並列に実行する
+        private:
+            std::vector<std::thread> workers;
+            std::deque<std::function<void()>> tasks;
+            std::mutex mtx;
+            std::condition_variable cv;
+            bool stop;
+
+            void work(void);
+            void push(std::function<void()>&& task);
+
+        public:
+            explicit ThreadPool(int threads=0); // threads : 呼び出し元を含めたスレッド数, 0 ならCPUのコア数
+            ~ThreadPool();
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+
+            int size(void) const {return workers.size() + 1;};
+
+            // [begin, end) の各 i について f(i) を実行して全て終わるまで待つ
+            // i は空いているスレッドから順番に取るので処理時間に偏りがあっても良い, 呼び出し元のスレッドも処理に参加する
+            template <typename F>
+            void parallelFor(int begin, int end, F f){
+                if(end <= begin) return;
+                if(workers.empty() || end - begin == 1){
+                    for(int i=begin;i!=end;++i) f(i);
+                    return;
+                }
+                std::atomic<int> next(begin);
+                std::atomic<int> running(0);
+                std::mutex doneMtx;
+                std::condition_variable doneCv;
+                auto loop = [&](){
+                    for(int i=next++;i<end;i=next++) f(i);
+                };
+                const int helpers = std::min<int>(workers.size(), end - begin - 1);
+                running = helpers;
+                for(int h=0;h!=helpers;++h){
+                    push([&](){
+                        loop();
+                        std::lock_guard<std::mutex> lock(doneMtx);
+                        if(--running == 0) doneCv.notify_one();
+                    });
+                }
+                loop();
+                std::unique_lock<std::mutex> lock(doneMtx);
+                doneCv.wait(lock,[&running]{return running == 0;});
+            };
+    };
+}
+
+#endif // THREAD_POOL_H
@@ -3,10 +3,14 @@
 
 #include <memory>
 #include <Eigen/Core>
+#include <Eigen/Geometry>
 
 // 前方宣言
 
 /// ros
+namespace ros{
+    class Time;
+}
 namespace tf{
     class TransformListener;
 }
@@ -40,6 +44,19 @@ namespace ExpLib{
         template <typename T> T coordinateConverter2d(const tf::TransformListener& l, const std::string& destFrame, const std::string& origFrame, geometry_msgs::Point& p);
         template <typename T> T coordinateConverter2d(const tf::TransformListener& l, const std::string& destFrame, const std::string& origFrame, const geometry_msgs::Point& p);
         template <typename T> T coordinateConverter2d(const tf::TransformListener& l, const std::string& destFrame, const std::string& origFrame, pcl::PointXYZ& p);
+        // origFrame の座標を destFrame での座標にする 2 次元の変換を一度だけ取得する, 取得できなければ false
+        // 同じフレーム間の点をまとめて変換する時は coordinateConverter2d を点ごとに呼ばずにこちらで取得して使いまわす
+        bool lookupTransform2d(const tf::TransformListener& l, const std::string& destFrame, const std::string& origFrame, Eigen::Isometry2d& transform);
+        bool lookupTransform2d(const tf::TransformListener& l, const std::string& destFrame, const std::string& origFrame, const ros::Time& stamp, Eigen::Isometry2d& transform);
+        // x, y を持つ点 (geometry_msgs::Point, pcl::PointXYZ など) に変換をかける, z はそのまま
+        template <typename P> void transformPoint2d(const Eigen::Isometry2d& transform, P& p){
+            const Eigen::Vector2d v = transform * Eigen::Vector2d(p.x, p.y);
+            p.x = v.x();
+            p.y = v.y();
+        }
+        template <typename Points> void transformPoints2d(const Eigen::Isometry2d& transform, Points& points){
+            for(auto&& p : points) transformPoint2d(transform, p);
+        }
         geometry_msgs::Point mapIndexToCoordinate(int indexX,int indexY,const nav_msgs::MapMetaData& info);
         Eigen::Vector2i coordinateToMapIndex(const Eigen::Vector2d& coordinate,const nav_msgs::MapMetaData& info);
         Eigen::Vector2i coordinateToMapIndex(const geometry_msgs::Point& coordinate,const nav_msgs::MapMetaData& info);
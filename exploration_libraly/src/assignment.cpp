@@ -0,0 +1,65 @@
+#include <exploration_libraly/assignment.h>
+#include <cfloat>
+
+namespace ExpLib{
+    namespace Assignment{
+        std::vector<int> hungarian(const Eigen::MatrixXd& cost){
+            // 行の方が多ければ転置して解く
+            const bool transposed = cost.rows() > cost.cols();
+            const Eigen::MatrixXd c = transposed ? Eigen::MatrixXd(cost.transpose()) : cost;
+            const int n = c.rows();
+            const int m = c.cols();
+
+            // 行 1..n を一つずつ加えて, ポテンシャル u, v を保ったまま最短の増加路で割り当てを広げる (添字 0 は番兵)
+            std::vector<double> u(n+1,0), v(m+1,0);
+            std::vector<int> rowOf(m+1,0); // 列に割り当てた行
+            std::vector<int> way(m+1,0);
+            for(int i=1;i<=n;++i){
+                rowOf[0] = i;
+                int j0 = 0;
+                std::vector<double> minv(m+1,DBL_MAX);
+                std::vector<char> used(m+1,0);
+                do{
+                    used[j0] = 1;
+                    const int i0 = rowOf[j0];
+                    double delta = DBL_MAX;
+                    int j1 = 0;
+                    for(int j=1;j<=m;++j){
+                        if(used[j]) continue;
+                        const double cur = c(i0-1,j-1) - u[i0] - v[j];
+                        if(cur < minv[j]){
+                            minv[j] = cur;
+                            way[j] = j0;
+                        }
+                        if(minv[j] < delta){
+                            delta = minv[j];
+                            j1 = j;
+                        }
+                    }
+                    for(int j=0;j<=m;++j){
+                        if(used[j]){
+                            u[rowOf[j]] += delta;
+                            v[j] -= delta;
+                        }
+                        else minv[j] -= delta;
+                    }
+                    j0 = j1;
+                }while(rowOf[j0] != 0);
+                // 増加路をたどって割り当てを入れ替える
+                do{
+                    const int j1 = way[j0];
+                    rowOf[j0] = rowOf[j1];
+                    j0 = j1;
+                }while(j0 != 0);
+            }
+
+            std::vector<int> result(cost.rows(),-1);
+            for(int j=1;j<=m;++j){
+                if(rowOf[j] == 0) continue;
+                if(transposed) result[j-1] = rowOf[j]-1;
+                else result[rowOf[j]-1] = j-1;
+            }
+            return result;
+        }
+    }
+}
@@ -0,0 +1,112 @@
+#include <exploration_libraly/distance_field.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+
+namespace{
+    // navfn と同じセルのコスト (COST_NEUTRAL + COST_FACTOR * v), 通れなければ負
+    // 未知 (255) は allowUnknown の時だけ 253 と同じコストで通れる
+    inline float cellCost(unsigned char v, bool allowUnknown){
+        if(v == 255) return allowUnknown ? 253.0f : -1.0f;
+        if(v >= 253) return -1.0f;
+        return std::min(50.0f + 0.8f * v, 253.0f);
+    };
+}
+
+namespace ExpLib{
+    DistanceField::DistanceField():width(0),height(0),resolution(0),origin(0,0),source(-1){}
+
+    bool DistanceField::toIndex(const Eigen::Vector2d& p, int& index) const {
+        if(resolution <= 0) return false;
+        const double x = std::floor((p.x() - origin.x()) / resolution);
+        const double y = std::floor((p.y() - origin.y()) / resolution);
+        if(x < 0 || y < 0 || x >= width || y >= height) return false;
+        index = int(y) * width + int(x);
+        return true;
+    }
+
+    Eigen::Vector2d DistanceField::toPoint(int index) const {
+        return Eigen::Vector2d(origin.x() + (index % width + 0.5) * resolution, origin.y() + (index / width + 0.5) * resolution);
+    }
+
+    bool DistanceField::compute(const unsigned char* costs, int w, int h, double res, const Eigen::Vector2d& o, const Eigen::Vector2d& s, const std::vector<Eigen::Vector2d>& targets, bool allowUnknown){
+        width = w;
+        height = h;
+        resolution = res;
+        origin = o;
+        source = -1;
+        cost.assign(width*height, FLT_MAX);
+        parent.assign(width*height, -1);
+        if(!toIndex(s, source)) return false;
+
+        // 確定したら打ち切るセル, 重複と地図の外は除く
+        std::vector<int> goals;
+        goals.reserve(targets.size());
+        for(const auto& t : targets){
+            int i;
+            if(toIndex(t, i)) goals.emplace_back(i);
+        }
+        std::sort(goals.begin(), goals.end());
+        goals.erase(std::unique(goals.begin(), goals.end()), goals.end());
+        int remaining = goals.size();
+
+        // 地図の中に targets が無ければ探索しない
+        if(!targets.empty() && goals.empty()){
+            cost[source] = 0;
+            return true;
+        }
+
+        // 8 近傍, 斜めは √2 倍の長さ
+        const int dx[8] = {1,-1,0,0,1,1,-1,-1};
+        const int dy[8] = {0,0,1,-1,1,-1,1,-1};
+        const float length[8] = {1,1,1,1,float(M_SQRT2),float(M_SQRT2),float(M_SQRT2),float(M_SQRT2)};
+
+        // 起点と targets のセルはロボット自身や frontier なので障害物でも入れるものとする (navfn も起点のセルを空ける)
+        // targets のセルが通れない時はそこへは入れるがそこから先へは広げない, 起点と targets を入れ替えても同じ所にたどり着けるようにする
+        // 入る時のコストは通れるセルの最大 (253) にする
+        std::greater<std::pair<float,int>> later;
+        heap.clear();
+        cost[source] = 0;
+        heap.emplace_back(0.0f, source);
+        while(!heap.empty()){
+            std::pop_heap(heap.begin(), heap.end(), later);
+            const float c = heap.back().first;
+            const int i = heap.back().second;
+            heap.pop_back();
+            if(c > cost[i]) continue;
+            const bool goal = std::binary_search(goals.begin(), goals.end(), i);
+            if(remaining > 0 && goal && --remaining == 0) break;
+            if(goal && i != source && cellCost(costs[i], allowUnknown) < 0) continue;
+
+            const int x = i % width;
+            const int y = i / width;
+            for(int k=0;k<8;++k){
+                const int nx = x + dx[k];
+                const int ny = y + dy[k];
+                if(nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+                const int j = ny * width + nx;
+                float cc = cellCost(costs[j], allowUnknown);
+                if(cc < 0){
+                    if(!std::binary_search(goals.begin(), goals.end(), j)) continue;
+                    cc = 253.0f;
+                }
+                const float nc = c + cc * length[k];
+                if(nc >= cost[j]) continue;
+                cost[j] = nc;
+                parent[j] = i;
+                heap.emplace_back(nc, j);
+                std::push_heap(heap.begin(), heap.end(), later);
+            }
+        }
+        return true;
+    }
+
+    bool DistanceField::path(const Eigen::Vector2d& p, std::vector<Eigen::Vector2d>& points) const {
+        points.clear();
+        int i;
+        if(!toIndex(p, i) || cost[i] == FLT_MAX) return false;
+        for(;i!=-1;i=parent[i]) points.emplace_back(toPoint(i));
+        return true;
+    }
+}
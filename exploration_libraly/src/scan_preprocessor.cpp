@@ -0,0 +1,74 @@
+#include <exploration_libraly/scan_preprocessor.h>
+#include <exploration_libraly/struct.h>
+#include <sensor_msgs/LaserScan.h>
+#include <cmath>
+
+namespace ExpLib{
+    ScanPreprocessor::ScanPreprocessor():angleMin(0),angleIncrement(0),count(-1){}
+
+    void ScanPreprocessor::prepare(const sensor_msgs::LaserScan& scan){
+        const int n = scan.ranges.size();
+        if(n == count && scan.angle_min == angleMin && scan.angle_increment == angleIncrement) return;
+        angleMin = scan.angle_min;
+        angleIncrement = scan.angle_increment;
+        count = n;
+        angles.resize(n);
+        cosTable.resize(n);
+        sinTable.resize(n);
+        xs.resize(n);
+        ys.resize(n);
+        for(int i=0;i!=n;++i){
+            // 角度は各ノードが計算していたのと同じく float で求める
+            angles[i] = angleMin + angleIncrement * i;
+            cosTable[i] = std::cos(angles[i]);
+            sinTable[i] = std::sin(angles[i]);
+        }
+    }
+
+    const std::vector<float>& ScanPreprocessor::getAngles(void) const {
+        return angles;
+    }
+
+    const std::vector<float>& ScanPreprocessor::getCos(void) const {
+        return cosTable;
+    }
+
+    const std::vector<float>& ScanPreprocessor::getSin(void) const {
+        return sinTable;
+    }
+
+    void ScanPreprocessor::forwardRanges(const sensor_msgs::LaserScan& scan, std::vector<float>& out){
+        prepare(scan);
+        out.resize(count);
+        const float* r = scan.ranges.data();
+        const float* c = cosTable.data();
+        float* o = out.data();
+        // 分岐の無いループにしてベクトル化させる, nan * cos は nan になる
+        for(int i=0;i<count;++i) o[i] = r[i] * c[i];
+    }
+
+    void ScanPreprocessor::toScanStruct(const sensor_msgs::LaserScan& scan, Struct::scanStruct& ss, float xMax){
+        prepare(scan);
+        const float* r = scan.ranges.data();
+        const float* c = cosTable.data();
+        const float* s = sinTable.data();
+        float* x = xs.data();
+        float* y = ys.data();
+        // 全てのビームの x, y をまとめて求めてから使うものだけを詰める
+        for(int i=0;i<count;++i){
+            x[i] = r[i] * c[i];
+            y[i] = r[i] * s[i];
+        }
+        ss.ranges.clear();
+        ss.angles.clear();
+        ss.x.clear();
+        ss.y.clear();
+        for(int i=0;i<count;++i){
+            if(std::isnan(r[i]) || x[i] > xMax) continue;
+            ss.ranges.emplace_back(r[i]);
+            ss.angles.emplace_back(angles[i]);
+            ss.x.emplace_back(x[i]);
+            ss.y.emplace_back(y[i]);
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#include <exploration_libraly/spatial_hash.h>
+#include <cmath>
+
+namespace ExpLib{
+    SpatialHash::SpatialHash(double cellSize):cellSize(cellSize > 0 ? cellSize : 1.0){}
+
+    int64_t SpatialHash::toCell(double v) const {
+        return std::floor(v / cellSize);
+    }
+
+    uint64_t SpatialHash::key(int64_t x, int64_t y){
+        return (uint64_t(uint32_t(x)) << 32) | uint32_t(y);
+    }
+
+    void SpatialHash::reset(double size){
+        cellSize = size > 0 ? size : 1.0;
+        clear();
+    }
+
+    void SpatialHash::clear(void){
+        points.clear();
+        cells.clear();
+    }
+
+    void SpatialHash::insert(const Eigen::Vector2d& p){
+        cells[key(toCell(p.x()),toCell(p.y()))].emplace_back(points.size());
+        points.emplace_back(p);
+    }
+
+    int SpatialHash::size(void) const {
+        return points.size();
+    }
+
+    double SpatialHash::getCellSize(void) const {
+        return cellSize;
+    }
+
+    const Eigen::Vector2d& SpatialHash::point(int index) const {
+        return points[index];
+    }
+
+    bool SpatialHash::contains(const Eigen::Vector2d& p, double radius) const {
+        if(points.empty() || radius <= 0) return false;
+        const double rr = radius * radius;
+        for(int64_t x=toCell(p.x()-radius),xe=toCell(p.x()+radius);x<=xe;++x){
+            for(int64_t y=toCell(p.y()-radius),ye=toCell(p.y()+radius);y<=ye;++y){
+                const auto it = cells.find(key(x,y));
+                if(it == cells.end()) continue;
+                for(const auto& i : it->second){
+                    if((points[i] - p).squaredNorm() < rr) return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void SpatialHash::radiusSearch(const Eigen::Vector2d& p, double radius, std::vector<int>& indices) const {
+        indices.clear();
+        if(points.empty() || radius <= 0) return;
+        const double rr = radius * radius;
+        for(int64_t x=toCell(p.x()-radius),xe=toCell(p.x()+radius);x<=xe;++x){
+            for(int64_t y=toCell(p.y()-radius),ye=toCell(p.y()+radius);y<=ye;++y){
+                const auto it = cells.find(key(x,y));
+                if(it == cells.end()) continue;
+                for(const auto& i : it->second){
+                    if((points[i] - p).squaredNorm() < rr) indices.emplace_back(i);
+                }
+            }
+        }
+    }
+}
@@ -2,9 +2,43 @@
 #include <exploration_libraly/utility.h>
 #include <Eigen/Geometry>
 #include <nav_msgs/MapMetaData.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include <map>
 
 namespace ExpLib{
     namespace Struct{
+        std::shared_ptr<ros::AsyncSpinner> sharedSpinner(ros::CallbackQueue* queue){
+            static std::mutex mutex;
+            static std::map<ros::CallbackQueue*,std::weak_ptr<ros::AsyncSpinner>> spinners;
+            std::lock_guard<std::mutex> lock(mutex);
+            std::shared_ptr<ros::AsyncSpinner> spinner = spinners[queue].lock();
+            if(spinner) return spinner;
+            spinner.reset(new ros::AsyncSpinner(1,queue));
+            spinner->start();
+            spinners[queue] = spinner;
+            return spinner;
+        }
+
+        ros::CallbackQueue& mainQueue(void){
+            static ros::CallbackQueue queue;
+            return queue;
+        }
+
+        ros::NodeHandle mainQueueHandle(const std::string& ns){
+            ros::NodeHandle nh(ns);
+            nh.setCallbackQueue(&mainQueue());
+            return nh;
+        }
+
+        void spinMainQueue(void){
+            mainQueue().callAvailable(ros::WallDuration());
+        }
+
+        ros::CallbackQueue& latestValueQueue(void){
+            static ros::CallbackQueue queue;
+            return queue;
+        }
+
         scanStruct::scanStruct(int size){
             ranges.reserve(size);
             angles.reserve(size);
@@ -41,5 +75,75 @@ namespace ExpLib{
             width = right-left+1;
             height = bottom-top+1;
         }
+
+        int mapSearchWindow::knownCount(const GridView<const int8_t>& map) const {
+            int c = 0;
+            for(int y=top,ey=bottom+1;y!=ey;++y){
+                for(const int8_t *it=map.row(y)+left,*ite=map.row(y)+right+1;it!=ite;++it){
+                    if(*it >= 0) ++c;
+                }
+            }
+            return c;
+        }
+        int mapSearchWindow::occupiedCount(const GridView<const int8_t>& map) const {
+            int c = 0;
+            for(int y=top,ey=bottom+1;y!=ey;++y){
+                for(const int8_t *it=map.row(y)+left,*ite=map.row(y)+right+1;it!=ite;++it){
+                    if(*it == 100) ++c;
+                }
+            }
+            return c;
+        }
+        int mapSearchWindow::knownCount(const mapIntegral& mi) const {
+            return mi.knownCount(left,top,right,bottom);
+        }
+        int mapSearchWindow::occupiedCount(const mapIntegral& mi) const {
+            return mi.occupiedCount(left,top,right,bottom);
+        }
+
+        mapIntegral::mapIntegral():width(0),height(0){};
+        mapIntegral::mapIntegral(const GridView<const int8_t>& map)
+            :width(map.width)
+            ,height(map.height)
+            ,known((map.width+1)*(map.height+1),0)
+            ,occupied((map.width+1)*(map.height+1),0){
+            // 一行ずつ累積和を取りながら上の行の値を足す
+            const int w = width + 1;
+            for(int y=0;y!=height;++y){
+                const int8_t* row = map.row(y);
+                uint32_t rowKnown = 0;
+                uint32_t rowOccupied = 0;
+                for(int x=0;x!=width;++x){
+                    rowKnown += row[x] >= 0;
+                    rowOccupied += row[x] == 100;
+                    known[(y+1)*w+x+1] = known[y*w+x+1] + rowKnown;
+                    occupied[(y+1)*w+x+1] = occupied[y*w+x+1] + rowOccupied;
+                }
+            }
+        }
+        void mapIntegral::clear(void){
+            width = 0;
+            height = 0;
+            known.clear();
+            occupied.clear();
+        }
+        int mapIntegral::knownCount(int left, int top, int right, int bottom) const {
+            const int w = width + 1;
+            return known[(bottom+1)*w+right+1] - known[top*w+right+1] - known[(bottom+1)*w+left] + known[top*w+left];
+        }
+        int mapIntegral::occupiedCount(int left, int top, int right, int bottom) const {
+            const int w = width + 1;
+            return occupied[(bottom+1)*w+right+1] - occupied[top*w+right+1] - occupied[(bottom+1)*w+left] + occupied[top*w+left];
+        }
+
+        GridView<const int8_t> gridView(const nav_msgs::OccupancyGrid& m){
+            return GridView<const int8_t>(m.data.data(),m.info.width,m.info.height);
+        }
+        GridView<const int8_t> gridView(const nav_msgs::OccupancyGridConstPtr& m){
+            return GridView<const int8_t>(m->data.data(),m->info.width,m->info.height,m);
+        }
+        GridView<int8_t> gridView(const nav_msgs::OccupancyGridPtr& m){
+            return GridView<int8_t>(m->data.data(),m->info.width,m->info.height,m);
+        }
     }
 }
\ No newline at end of file
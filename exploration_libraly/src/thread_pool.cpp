@@ -0,0 +1,40 @@
+#include <exploration_libraly/thread_pool.h>
+
+namespace ExpLib{
+    ThreadPool::ThreadPool(int threads):stop(false){
+        if(threads <= 0) threads = std::max(1u,std::thread::hardware_concurrency());
+        workers.reserve(threads-1);
+        for(int i=1;i<threads;++i) workers.emplace_back(&ThreadPool::work,this);
+    }
+
+    ThreadPool::~ThreadPool(){
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        cv.notify_all();
+        for(auto&& w : workers) w.join();
+    }
+
+    void ThreadPool::work(void){
+        while(true){
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock,[this]{return stop || !tasks.empty();});
+                if(stop && tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    void ThreadPool::push(std::function<void()>&& task){
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            tasks.emplace_back(std::move(task));
+        }
+        cv.notify_one();
+    }
+}
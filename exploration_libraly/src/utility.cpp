@@ -53,6 +53,24 @@ namespace ExpLib{
             p = Convert::pointToPclPointXYZ(ps.position);
         }
 
+        bool lookupTransform2d(const tf::TransformListener& l, const std::string& destFrame, const std::string& origFrame, Eigen::Isometry2d& transform){
+            return lookupTransform2d(l,destFrame,origFrame,ros::Time(0),transform);
+        }
+
+        bool lookupTransform2d(const tf::TransformListener& l, const std::string& destFrame, const std::string& origFrame, const ros::Time& stamp, Eigen::Isometry2d& transform){
+            tf::StampedTransform st;
+            try {
+                l.lookupTransform(destFrame, origFrame, stamp, st);
+            }
+            catch (tf::TransformException &ex){
+                ROS_ERROR("%s",ex.what());
+                ROS_ERROR_STREAM("transform is failed");
+                return false;
+            }
+            transform = Eigen::Translation2d(st.getOrigin().getX(), st.getOrigin().getY()) * Eigen::Rotation2Dd(Convert::qToYaw(st.getRotation()));
+            return true;
+        }
+
         geometry_msgs::Point mapIndexToCoordinate(int indexX,int indexY,const nav_msgs::MapMetaData& info){
             return ExpLib::Construct::msgPoint(info.resolution * indexX + info.origin.position.x,info.resolution * indexY + info.origin.position.y);
         }
@@ -0,0 +1,94 @@
+#include <exploration_libraly/assignment.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+#include <random>
+
+namespace ExAsn = ExpLib::Assignment;
+
+namespace{
+    // 少ない方の全ての並べ方を試して最小の合計を求める
+    double bruteForce(const Eigen::MatrixXd& cost){
+        const bool transposed = cost.rows() > cost.cols();
+        const Eigen::MatrixXd c = transposed ? Eigen::MatrixXd(cost.transpose()) : cost;
+        std::vector<int> cols(c.cols());
+        std::iota(cols.begin(),cols.end(),0);
+        double best = DBL_MAX;
+        do{
+            double sum = 0;
+            for(int i=0;i<c.rows();++i) sum += c(i,cols[i]);
+            best = std::min(best,sum);
+        }while(std::next_permutation(cols.begin(),cols.end()));
+        return best;
+    }
+
+    // 割り当てが正しい形か確かめて合計を返す
+    double checkedSum(const Eigen::MatrixXd& cost, const std::vector<int>& result){
+        EXPECT_EQ((int)result.size(), cost.rows());
+        std::vector<char> used(cost.cols(),0);
+        int assigned = 0;
+        double sum = 0;
+        for(int i=0;i<(int)result.size();++i){
+            if(result[i] < 0) continue;
+            EXPECT_LT(result[i], cost.cols());
+            EXPECT_FALSE(used[result[i]]) << "column " << result[i] << " is assigned twice";
+            used[result[i]] = 1;
+            sum += cost(i,result[i]);
+            ++assigned;
+        }
+        EXPECT_EQ(assigned, std::min(cost.rows(),cost.cols()));
+        return sum;
+    }
+
+    void compare(int rows, int cols, int trials){
+        std::mt19937 gen(rows * 100 + cols);
+        std::uniform_real_distribution<double> value(0.0,10.0);
+        for(int t=0;t<trials;++t){
+            Eigen::MatrixXd cost(rows,cols);
+            for(int i=0;i<rows;++i){
+                for(int j=0;j<cols;++j) cost(i,j) = value(gen);
+            }
+            EXPECT_NEAR(checkedSum(cost,ExAsn::hungarian(cost)), bruteForce(cost), 1e-9) << "rows : " << rows << ", cols : " << cols << ", trial : " << t;
+        }
+    }
+}
+
+TEST(Hungarian, Square){
+    for(int n=1;n<=6;++n) compare(n,n,50);
+}
+
+TEST(Hungarian, MoreRowsThanCols){
+    // ロボットの方が目標候補より多い
+    compare(3,1,50);
+    compare(4,2,50);
+    compare(6,3,50);
+    compare(7,5,20);
+}
+
+TEST(Hungarian, MoreColsThanRows){
+    // 目標候補の方がロボットより多い
+    compare(1,3,50);
+    compare(2,4,50);
+    compare(3,6,50);
+    compare(5,7,20);
+}
+
+TEST(Hungarian, Ties){
+    // 同じコストばかりでも列を重複させない
+    const Eigen::MatrixXd cost = Eigen::MatrixXd::Ones(4,3);
+    EXPECT_NEAR(checkedSum(cost,ExAsn::hungarian(cost)), 3.0, 1e-9);
+}
+
+TEST(Hungarian, Empty){
+    EXPECT_TRUE(ExAsn::hungarian(Eigen::MatrixXd(0,3)).empty());
+    const std::vector<int> result = ExAsn::hungarian(Eigen::MatrixXd(2,0));
+    ASSERT_EQ((int)result.size(), 2);
+    EXPECT_EQ(result[0], -1);
+    EXPECT_EQ(result[1], -1);
+}
+
+int main(int argc, char** argv){
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -12,12 +12,18 @@ namespace boost{
 }
 /// my packages
 namespace ExpLib{
+    class ScanPreprocessor;
+    class SpatialHash;
+    template <typename T>
+    class RingHistory;
     namespace Struct{
         template<typename T>
         struct pubStruct;
         template<typename T>
         struct subStruct;
         struct subStructSimple;
+        struct mapIntegral;
+        struct scanStruct;
     }
 }
 namespace exploration_msgs{
@@ -77,11 +83,16 @@ class BranchDetection{
         double BRANCH_DIFF_X_MAX;
         double BRANCH_DIFF_Y_MIN;
         double BRANCH_DIFF_Y_MAX;
+        int GAP_SCALES; // 隙間を調べる尺度の数, 1 (既定) なら隣り合う点だけで以前の検出と同じ
+        int GAP_MIN_SCALES; // 分岐とするのに必要な尺度の数, スキャンの端で調べられる尺度が少ない時はその数まで
+        double BRANCH_CONFIDENCE_MIN;
         bool SCAN_FILTER;
         int SCAN_FILTER_ORDER;
         bool BRANCH_FILTER;
         int BRANCH_FILTER_ORDER;
         double BRANCH_FILTER_TOLERANCE;
+        int FILTER_HISTORY_CAPACITY;
+        double FILTER_HISTORY_HORIZON;
         bool DUPLICATE_DETECTION;
         double DUPLICATE_TOLERANCE;
         double LOG_CURRENT_TIME;//if 30 -> 30秒前までのログで重複検出
@@ -105,13 +116,22 @@ class BranchDetection{
         std::unique_ptr<ExStc::pubStruct<exploration_msgs::BranchArray>> branch_;
         std::unique_ptr<ExStc::pubStruct<sensor_msgs::LaserScan>> filteredScan_;
         std::unique_ptr<dynamic_reconfigure::Server<exploration_support::branch_detection_parameter_reconfigureConfig>> drs_;
+        std::unique_ptr<ExStc::mapIntegral> mapIntegral_; // onMapBranchDetection 用の積分画像
+        double mapIntegralStamp_; // mapIntegral_ を作った地図のタイムスタンプ
+        std::unique_ptr<ExpLib::RingHistory<sensor_msgs::LaserScan>> scanLog_; // scanFilter 用
+        std::unique_ptr<ExpLib::RingHistory<std::vector<exploration_msgs::Branch>>> branchLog_; // branchFilter, branchConfidence 用
+        std::unique_ptr<ExpLib::SpatialHash> poseHash_; // duplicateBranchDetection 用, poseLog_ の位置を同じ順番で持つ
+        std::unique_ptr<ExpLib::ScanPreprocessor> scanPre_; // スキャンの sin, cos の表
 
         // functions
         void scanCB(const sensor_msgs::LaserScanConstPtr& msg);
         sensor_msgs::LaserScan scanFilter(const sensor_msgs::LaserScan& scan);
+        void gapDetection(const ExStc::scanStruct& ss, std::vector<exploration_msgs::Branch>& branches);
+        void branchConfidence(std::vector<exploration_msgs::Branch>& branches, double stamp);
         // void branchFilter(std::vector<geometry_msgs::Point>& branches);
         void branchFilter(std::vector<exploration_msgs::Branch>& branches);
         void duplicateBranchDetection(std::vector<exploration_msgs::Branch>& branches);
+        void updatePoseHash(const nav_msgs::Path& log);
         void onMapBranchDetection(std::vector<exploration_msgs::Branch>& branches);
         // void publishBranch(const std::vector<geometry_msgs::Point>& branches, const std::string& frameId);
         void publishBranch(const std::vector<exploration_msgs::Branch>& branches, const std::string& frameId);
@@ -12,9 +12,12 @@ namespace boost{
 }
 /// my packages
 namespace ExpLib{
+    class ThreadPool;
     namespace Struct{
         template<typename T>
         struct pubStruct;
+        template<typename T>
+        struct subStruct;
         struct subStructSimple;
     }
 }
@@ -25,6 +28,12 @@ namespace exploration_msgs{
     template <class ContainerAllocator>
     struct FrontierArray_;
     typedef ::exploration_msgs::FrontierArray_<std::allocator<void>> FrontierArray;
+    template <class ContainerAllocator>
+    struct FrontierDetectionStatus_;
+    typedef ::exploration_msgs::FrontierDetectionStatus_<std::allocator<void>> FrontierDetectionStatus;
+    template <class ContainerAllocator>
+    struct RobotInfoArray_;
+    typedef ::exploration_msgs::RobotInfoArray_<std::allocator<void>> RobotInfoArray;
 }
 namespace exploration_support{
     class frontier_detection_parameter_reconfigureConfig;
@@ -35,6 +44,12 @@ namespace dynamic_reconfigure{
     class Server;
 }
 /// rosmsgs
+namespace map_msgs{
+    template <class ContainerAllocator>
+    struct OccupancyGridUpdate_;
+    typedef ::map_msgs::OccupancyGridUpdate_<std::allocator<void>> OccupancyGridUpdate;
+    typedef boost::shared_ptr< ::map_msgs::OccupancyGridUpdate const> OccupancyGridUpdateConstPtr;
+}
 namespace nav_msgs{
     template <class ContainerAllocator>
     struct OccupancyGrid_;
@@ -46,6 +61,12 @@ namespace sensor_msgs{
     struct PointCloud2_;
     typedef ::sensor_msgs::PointCloud2_<std::allocator<void>> PointCloud2;
 }
+/// others
+namespace pcl{
+    struct PointXYZRGB;
+    template <typename PointT>
+    class PointCloud;
+}
 // 前方宣言ここまで
 
 namespace ExStc = ExpLib::Struct;
@@ -53,6 +74,8 @@ namespace ExStc = ExpLib::Struct;
 class FrontierDetection{
     private:
         // dynamic parameters
+        int WORKER_THREADS;
+        bool GRID_CLUSTERING;
         double CLUSTER_TOLERANCE;
         int MIN_CLUSTER_SIZE;
         int MAX_CLUSTER_SIZE;
@@ -64,30 +87,65 @@ class FrontierDetection{
         double VARIANCE_THRESHOLD;
         double VARIANCE_MIN_THRESHOLD;
         double COVARIANCE_THRESHOLD;
+        double TRACKING_DISTANCE;
+        bool WAVEFRONT_DETECTION;
+        double WAVEFRONT_SEED_RADIUS;
 
         // static parameters
         std::string FRONTIER_PARAMETER_FILE_PATH;
         bool OUTPUT_FRONTIER_PARAMETERS;
+        bool USE_MAP_UPDATES;
 
         // struct
         struct mapStruct;
         struct clusterStruct;
+        struct clusterCacheStruct;
+        struct trackerStruct;
+        struct wavefrontStruct;
 
         // variables
         std::unique_ptr<ExStc::subStructSimple> map_;
+        std::unique_ptr<ExStc::subStructSimple> mapUpdate_;
+        std::unique_ptr<ExStc::subStruct<exploration_msgs::RobotInfoArray>> robotArray_;
         std::unique_ptr<ExStc::pubStruct<exploration_msgs::FrontierArray>> frontier_;
         std::unique_ptr<ExStc::pubStruct<sensor_msgs::PointCloud2>> horizon_;
+        std::unique_ptr<ExStc::pubStruct<exploration_msgs::FrontierDetectionStatus>> status_;
+        std::unique_ptr<exploration_msgs::FrontierDetectionStatus> statusMsg_; // 処理中の地図の各段階の処理時間など
         std::unique_ptr<dynamic_reconfigure::Server<exploration_support::frontier_detection_parameter_reconfigureConfig>> drs_;
+        std::unique_ptr<mapStruct> mapCache_; // map_updates を適用し続ける地図と horizon
+        std::unique_ptr<clusterCacheStruct> clusterCache_; // mapCache_ に対応するクラスタと frontier, 差分更新で作り直せるように大きさで捨てずに全ての horizon を持つ
+        std::unique_ptr<trackerStruct> tracker_; // frontier に安定した id を振るために前回の frontier を保持する
+        std::unique_ptr<wavefrontStruct> wavefront_; // wavefront frontier detection の探索用バッファ
+        std::unique_ptr<ExpLib::ThreadPool> pool_; // horizon, クラスタリング, 障害物判定を並列に行う
+        std::unique_ptr<pcl::PointCloud<pcl::PointXYZRGB>> horizonCloud_; // publishHorizon で使いまわすバッファ
+        std::unique_ptr<sensor_msgs::PointCloud2> horizonMsg_;
 
         // functions
         void mapCB(const nav_msgs::OccupancyGridConstPtr& msg);
+        void mapUpdateCB(const map_msgs::OccupancyGridUpdateConstPtr& msg);
+        void frontierDetection(mapStruct& map, clusterStruct& cs, const std::string& frameId, std::vector<exploration_msgs::Frontier>& frontiers, std::vector<int>& clusterOf);
+        void cachedFrontierDetection(mapStruct& map, const std::string& frameId);
+        void incrementalFrontierDetection(mapStruct& map, int left, int top, int right, int bottom, const std::string& frameId);
+        clusterStruct horizonClustering(mapStruct& map, bool allSizes=false);
+        bool wavefrontSeeds(const mapStruct& map, std::vector<int>& seeds);
+        void wavefrontDetection(mapStruct& map, const std::vector<int>& seeds, clusterStruct& cs);
         void horizonDetection(mapStruct& map);
-        clusterStruct clusterDetection(const mapStruct& map);
+        void horizonDetection(mapStruct& map, int left, int top, int right, int bottom);
+        clusterStruct clusterDetection(const mapStruct& map, bool allSizes=false);
+        void clusterDetection(const mapStruct& map, clusterStruct& cs, bool allSizes=false);
+        clusterStruct clusterSizeFilter(const clusterStruct& cs);
+        void clusterUpdate(const mapStruct& map, int left, int top, int right, int bottom, std::vector<int>& added);
+        void frontierUpdate(const mapStruct& map, int left, int top, int right, int bottom, const std::vector<int>& added, std::vector<uint32_t>& removedIds);
+        bool hasObstacle(const mapStruct& map, int cx, int cy);
         void obstacleFilter(mapStruct& map,clusterStruct& cs);
         void publishHorizon(const clusterStruct& cs, const std::string& frameId);
+        void publishHorizon(const mapStruct& map, const clusterCacheStruct& cache, const std::string& frameId);
+        void publishHorizonCloud(const std::string& frameId);
         void onMapFrontierDetection(const FrontierDetection::mapStruct& map, std::vector<exploration_msgs::Frontier>& frontiers);
         void usefulFrontierDetection(std::vector<exploration_msgs::Frontier>& frontiers);
-        void publishFrontier(const std::vector<exploration_msgs::Frontier>& frontiers, const std::string& frameId);
+        void frontierTracking(const mapStruct& map, const clusterStruct& cs, const std::vector<int>& clusterOf, std::vector<exploration_msgs::Frontier>& frontiers, std::vector<uint32_t>& removedIds);
+        void publishFrontier(const std::vector<exploration_msgs::Frontier>& frontiers, const std::vector<uint32_t>& removedIds, const std::string& frameId);
+        void publishStatus(void);
         void loadParams(void);
         void dynamicParamsCB(exploration_support::frontier_detection_parameter_reconfigureConfig &cfg, uint32_t level);
         void outputParams(void);
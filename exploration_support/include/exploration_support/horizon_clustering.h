@@ -0,0 +1,50 @@
+#ifndef HORIZON_CLUSTERING_H
+#define HORIZON_CLUSTERING_H
+
+#include <Eigen/Core>
+#include <pcl/PointIndices.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <cstdint>
+#include <vector>
+
+// 前方宣言
+/// nav_msgs
+namespace nav_msgs{
+    template <class ContainerAllocator>
+    struct MapMetaData_;
+    typedef ::nav_msgs::MapMetaData_<std::allocator<void>> MapMetaData;
+}
+/// ExpLib
+namespace ExpLib{
+    class ThreadPool;
+}
+// 前方宣言ここまで
+
+// horizon のセルを許容距離以内のもの同士が同じクラスタになるように分ける
+// 格子上の union-find と pcl の EuclideanClusterExtraction の二つの方法があり, どちらも同じクラスタを同じ統計値で返す
+// 結果は点の数が [minSize, maxSize] のクラスタを点の多い順に並べたもの, indices は cells の番号で各クラスタの中では昇順
+
+namespace HorizonClustering{
+    // クラスタの統計量の元になるモーメント
+    // 座標はセル番号の整数で積算するので分散の桁落ちが起きない
+    struct moment{
+        int count;
+        int64_t sx, sy, sxx, syy, sxy;
+        Eigen::Vector4i bounds; // 外接矩形の二次元配列インデックス (left, top, right, bottom)
+
+        moment();
+        void add(int x, int y);
+        Eigen::Vector2d centroid(const nav_msgs::MapMetaData& info) const; // 重心の座標
+        Eigen::Vector2d variance(double resolution) const;
+        double covariance(double resolution) const; // x, y の相関係数
+        double area(double resolution) const; // 外接矩形の面積 (端のセルの中心の間)
+    };
+
+    // 格子上の union-find, cells は y, x の順に並んでいること
+    void grid(const std::vector<Eigen::Vector2i>& cells, const nav_msgs::MapMetaData& info, double tolerance, int minSize, int maxSize, ExpLib::ThreadPool& pool, std::vector<pcl::PointIndices>& indices, std::vector<moment>& moments);
+    // pcl の EuclideanClusterExtraction, pc は cells を同じ順に座標にしたもの
+    void euclidean(const std::vector<Eigen::Vector2i>& cells, const pcl::PointCloud<pcl::PointXYZ>::Ptr& pc, double tolerance, int minSize, int maxSize, std::vector<pcl::PointIndices>& indices, std::vector<moment>& moments);
+}
+
+#endif // HORIZON_CLUSTERING_H
@@ -0,0 +1,36 @@
+#ifndef HORIZON_KERNEL_H
+#define HORIZON_KERNEL_H
+
+#include <algorithm>
+#include <cstdint>
+
+// occupancy grid の一次元配列(row-major)から horizon (未知領域に接する自由領域のセル)を求める
+// 自由領域 : 0 <= v < 99, 未知領域 : v == -1, 上下左右のどれかが未知領域なら horizon
+// 結果は一行あたり wordsPerRow(width) 個の uint64_t に x 番目のセルを (x>>6) 番目の (x&63) ビットとして詰める
+
+namespace HorizonKernel{
+    enum class Isa{
+        SCALAR,
+        SSE2,
+        AVX2
+    };
+
+    Isa bestIsa(void); // 実行中の CPU で使える一番速い命令セット
+    const char* isaName(Isa isa);
+    inline int wordsPerRow(int width){return (width + 63) >> 6;};
+    // rows 行を threads 個のスレッドで処理する時の帯の高さ, 偏りが出ないようにスレッド数より多めに分ける
+    inline int bandHeight(int rows, int threads){return threads == 1 ? std::max(1,rows) : std::max(1,(rows + threads*4 - 1) / (threads*4));};
+    inline bool isFree(int8_t v){return 0 <= v && v < 99;};
+    inline bool test(const uint64_t* bitmap, int words, int x, int y){return (bitmap[y*words + (x>>6)] >> (x&63)) & 1;};
+    // bitmap は height*wordsPerRow(width) 個確保しておくこと
+    void horizon(const int8_t* data, int width, int height, uint64_t* bitmap, Isa isa);
+    void horizon(const int8_t* data, int width, int height, uint64_t* bitmap);
+    // 行 [top, bottom) だけを求める, 行ごとに独立しているので別々のスレッドで呼んで良い
+    void horizonRows(const int8_t* data, int width, int height, int top, int bottom, uint64_t* bitmap, Isa isa);
+    // 行 y のうち [left, right] の範囲だけ作り直す, 範囲外のビットは変更しない
+    void horizonRow(const int8_t* data, int width, int height, int y, int left, int right, uint64_t* bitmap);
+    // セル (x, y) が horizon か
+    bool isHorizon(const int8_t* data, int width, int height, int x, int y);
+}
+
+#endif // HORIZON_KERNEL_H
@@ -1,5 +1,8 @@
 #include <exploration_support/branch_detection.h>
 #include <exploration_libraly/construct.h>
+#include <exploration_libraly/ring_history.h>
+#include <exploration_libraly/scan_preprocessor.h>
+#include <exploration_libraly/spatial_hash.h>
 #include <exploration_libraly/struct.h>
 #include <exploration_libraly/utility.h>
 // #include <exploration_msgs/PointArray.h>
@@ -26,7 +29,13 @@ BranchDetection::BranchDetection()
     // ,branch_(new ExStc::pubStruct<exploration_msgs::PointArray>("branch", 1))
     ,branch_(new ExStc::pubStruct<exploration_msgs::BranchArray>("branch", 1))
     ,filteredScan_(new ExStc::pubStruct<sensor_msgs::LaserScan>("filtered_scan", 1))
-    ,drs_(new dynamic_reconfigure::Server<exploration_support::branch_detection_parameter_reconfigureConfig>(ros::NodeHandle("~/branch"))){
+    ,drs_(new dynamic_reconfigure::Server<exploration_support::branch_detection_parameter_reconfigureConfig>(ros::NodeHandle("~/branch")))
+    ,mapIntegral_(new ExStc::mapIntegral())
+    ,mapIntegralStamp_(0)
+    ,scanLog_(new ExpLib::RingHistory<sensor_msgs::LaserScan>())
+    ,branchLog_(new ExpLib::RingHistory<std::vector<exploration_msgs::Branch>>())
+    ,poseHash_(new ExpLib::SpatialHash())
+    ,scanPre_(new ExpLib::ScanPreprocessor()){
     loadParams();
     drs_->setCallback(boost::bind(&BranchDetection::dynamicParamsCB,this, _1, _2));
 }
@@ -75,15 +84,7 @@ void BranchDetection::scanCB(const sensor_msgs::LaserScanConstPtr& msg){
 	// 		ss.angles.emplace_back(std::move(temp));
 	// 	}
     // }
-    for(int i=0,e=scan.ranges.size();i!=e;++i){
-		if(!std::isnan(scan.ranges[i])){
-            float temp = scan.angle_min+(scan.angle_increment*i);
-			ss.ranges.emplace_back(scan.ranges[i]);
-            ss.x.emplace_back(scan.ranges[i]*cos(temp));
-            ss.y.emplace_back(scan.ranges[i]*sin(temp));
-			ss.angles.emplace_back(std::move(temp));
-		}
-    }
+    scanPre_->toScanStruct(scan,ss);
     if(ss.ranges.size() < 2){
 		ROS_ERROR_STREAM("Scan data is insufficient");
         publishBranch(std::vector<exploration_msgs::Branch>(),pose_->data.header.frame_id);
@@ -94,24 +95,22 @@ void BranchDetection::scanCB(const sensor_msgs::LaserScanConstPtr& msg){
     // std::vector<geometry_msgs::Point> branches; // 検出した分岐領域を入れる
     std::vector<exploration_msgs::Branch> branches; // 検出した分岐領域を入れる
 
-    for(int i=0,e=ss.ranges.size()-1;i!=e;++i){
-		if(ss.angles[i] * ss.angles[i+1] < 0) continue; // 二つの角度の符号が違うときスキップ/
-        if(ss.ranges[i] > BRANCH_RANGE_MAX || ss.ranges[i+1] > BRANCH_RANGE_MAX) continue; // 距離が遠いのは信用できないのでだめ
-        if(ss.ranges[i] < BRANCH_RANGE_MIN || ss.ranges[i+1] < BRANCH_RANGE_MIN) continue; // 距離が近すぎるのもだめ
-        if(ss.y[i] <= ss.y[i+1]) continue; // yの大きさが i < i+1 だとNG
-        if((ss.angles[i] < 0 && ss.x[i] >= ss.x[i+1]) || (ss.angles[i] >= 0 && ss.x[i] <= ss.x[i+1])) continue; // xの差を判定
-        double diffX = std::abs(ss.x[i+1] - ss.x[i]);
-        if(BRANCH_DIFF_X_MIN > diffX || diffX > BRANCH_DIFF_X_MAX) continue; //x座標の差(分岐の幅)が範囲内じゃないと分岐と認めない
-        double diffY = std::abs(ss.y[i+1] - ss.y[i]);
-        if(BRANCH_DIFF_Y_MIN > diffY || diffY > BRANCH_DIFF_Y_MAX) continue; //y座標の差が範囲内じゃないと分岐と認めない
-        // 検出した座標をpose座標系に変換して input
-        // branches.emplace_back(ExUtl::coordinateConverter2d<geometry_msgs::Point>(listener, pose_->data.header.frame_id, msg->header.frame_id, ExCos::msgPoint((ss.x[i+1] + ss.x[i])/2, (ss.y[i+1] + ss.y[i])/2)));
-        // branches.emplace_back(ExUtl::coordinateConverter2d<geometry_msgs::Point>(listener, pose_->data.header.frame_id, scan.header.frame_id, ExCos::msgPoint((ss.x[i+1] + ss.x[i])/2, (ss.y[i+1] + ss.y[i])/2)));
-        branches.emplace_back(ExCos::msgBranch(ExUtl::coordinateConverter2d<geometry_msgs::Point>(listener, pose_->data.header.frame_id, scan.header.frame_id, ExCos::msgPoint((ss.x[i+1] + ss.x[i])/2, (ss.y[i+1] + ss.y[i])/2))));
-	}
+    gapDetection(ss,branches);
+
+    // 変換はスキャンごとに一度だけ取得して全ての分岐に使う
+    Eigen::Isometry2d transform;
+    if(!branches.empty() && ExUtl::lookupTransform2d(listener, pose_->data.header.frame_id, scan.header.frame_id, transform)){
+        for(auto&& b : branches) ExUtl::transformPoint2d(transform, b.point);
+    }
 
     ROS_INFO_STREAM("Branch Found : " << branches.size());
     
+    branchConfidence(branches,scan.header.stamp.toSec());
+    if(BRANCH_CONFIDENCE_MIN > 0){
+        branches.erase(std::remove_if(branches.begin(),branches.end(),[this](const exploration_msgs::Branch& b){return b.confidence < BRANCH_CONFIDENCE_MIN;}),branches.end());
+        ROS_INFO_STREAM("confident Branch size: " << branches.size());
+    }
+
     if(BRANCH_FILTER){
         branchFilter(branches);
         ROS_INFO_STREAM("filtered Branch size: " << branches.size());
@@ -125,41 +124,129 @@ void BranchDetection::scanCB(const sensor_msgs::LaserScanConstPtr& msg){
 }
 
 sensor_msgs::LaserScan BranchDetection::scanFilter(const sensor_msgs::LaserScan& scan){
-    static std::vector<sensor_msgs::LaserScan> scanLog;
-    scanLog.emplace_back(scan);
-    if(scanLog.size()<SCAN_FILTER_ORDER) return scan;
+    // 履歴は個数と時間で上限を決めて古いものから上書きする, 容量はフィルタの次数より小さくしない
+    const int capacity = std::max(FILTER_HISTORY_CAPACITY,SCAN_FILTER_ORDER);
+    if(scanLog_->capacity() != capacity || scanLog_->getHorizon() != FILTER_HISTORY_HORIZON) scanLog_->reset(capacity,FILTER_HISTORY_HORIZON);
+    scanLog_->push(scan.header.stamp.toSec()) = scan;
+    if(scanLog_->size()<SCAN_FILTER_ORDER) return scan;
 
     sensor_msgs::LaserScan filteredScan = scan;
 
     for(int i=0,ie=filteredScan.ranges.size();i!=ie;++i){
         float sum = 0;
         int nan = 0;
-        for(int j=scanLog.size()-1,je=j-SCAN_FILTER_ORDER;j!=je;--j){
-            if(!std::isnan(scanLog[j].ranges[i])) sum += scanLog[j].ranges[i];
+        for(int j=0;j!=SCAN_FILTER_ORDER;++j){
+            const float r = scanLog_->at(j).ranges[i];
+            if(!std::isnan(r)) sum += r;
             else ++nan;
         }
         if(nan == SCAN_FILTER_ORDER) continue;
         filteredScan.ranges[i] = sum/(SCAN_FILTER_ORDER-nan);
     }
 
-    filteredScan_->pub.publish(filteredScan);
+    // 表示用なので購読者がいる時だけ publish する
+    if(filteredScan_->pub.getNumSubscribers() > 0) filteredScan_->pub.publish(filteredScan);
     return filteredScan;
 }
 
+void BranchDetection::gapDetection(const ExStc::scanStruct& ss, std::vector<exploration_msgs::Branch>& branches){
+    // 隣り合う点の間の隙間を, 両側の点を 1, 2, ..., GAP_SCALES 個ずつ平均した位置でも調べる
+    // 隣り合う点で見つかり, GAP_MIN_SCALES 個以上の尺度で残った隙間だけを分岐とする (ノイズで一瞬できた隙間は大きい尺度で消える)
+    // GAP_SCALES = 1 (既定) なら隣り合う点だけを見る以前の検出と同じ
+    const int n = ss.ranges.size();
+    for(int i=0,e=n-1;i!=e;++i){
+        if(ss.ranges[i] > BRANCH_RANGE_MAX || ss.ranges[i+1] > BRANCH_RANGE_MAX) continue; // 距離が遠いのは信用できないのでだめ
+        if(ss.ranges[i] < BRANCH_RANGE_MIN || ss.ranges[i+1] < BRANCH_RANGE_MIN) continue; // 距離が近すぎるのもだめ
+
+        // 尺度 s では i-s ~ i と i+1 ~ i+1+s の平均の位置で判定する, s = 0 は隣り合う点そのもの
+        // スキャンの端では足りない側の窓を端までに縮める
+        auto gap = [&](int s, double& diffX, double& diffY){
+            const int sa = std::min(s,i);
+            const int sb = std::min(s,n-2-i);
+            if(ss.angles[i-sa] * ss.angles[i+1+sb] < 0) return false; // 二つの角度の符号が違うときスキップ
+            double ax = 0, ay = 0, bx = 0, by = 0;
+            for(int j=0;j<=sa;++j){
+                ax += ss.x[i-j];
+                ay += ss.y[i-j];
+            }
+            for(int j=0;j<=sb;++j){
+                bx += ss.x[i+1+j];
+                by += ss.y[i+1+j];
+            }
+            ax /= sa + 1;
+            ay /= sa + 1;
+            bx /= sb + 1;
+            by /= sb + 1;
+            if(ay <= by) return false; // yの大きさが i < i+1 だとNG
+            if((ss.angles[i] < 0 && ax >= bx) || (ss.angles[i] >= 0 && ax <= bx)) return false; // xの差を判定
+            diffX = std::abs(bx - ax);
+            if(BRANCH_DIFF_X_MIN > diffX || diffX > BRANCH_DIFF_X_MAX) return false; //x座標の差(分岐の幅)が範囲内じゃないと分岐と認めない
+            diffY = std::abs(by - ay);
+            if(BRANCH_DIFF_Y_MIN > diffY || diffY > BRANCH_DIFF_Y_MAX) return false; //y座標の差が範囲内じゃないと分岐と認めない
+            return true;
+        };
+
+        double diffX, diffY;
+        if(!gap(0,diffX,diffY)) continue;
+        int scales = 1;
+        int evaluated = 1; // 調べられた尺度の数, 両側とも端まで使い切ったらそれ以上は同じ窓になるので数えない
+        double width = diffX;
+        double depth = diffY;
+        for(int s=1;s<GAP_SCALES && (s<=i || s<=n-2-i);++s){
+            ++evaluated;
+            if(!gap(s,diffX,diffY)) continue;
+            ++scales;
+            width += diffX;
+            depth += diffY;
+        }
+        if(scales < std::min(GAP_MIN_SCALES,evaluated)) continue;
+
+        // 検出した座標を input, pose座標系への変換は後でまとめて行う
+        // 幅と奥行きは残った尺度での平均, 信頼度はひとまず残った尺度の割合にして branchConfidence で持続性を掛ける
+        exploration_msgs::Branch b = ExCos::msgBranch(ExCos::msgPoint((ss.x[i+1] + ss.x[i])/2, (ss.y[i+1] + ss.y[i])/2));
+        b.width = width / scales;
+        b.depth = depth / scales;
+        b.confidence = (double)scales / evaluated;
+        branches.emplace_back(std::move(b));
+    }
+}
+
+void BranchDetection::branchConfidence(std::vector<exploration_msgs::Branch>& branches, double stamp){
+    // 履歴は個数と時間で上限を決めて古いものから上書きする, 容量はフィルタの次数より小さくしない
+    const int capacity = std::max(FILTER_HISTORY_CAPACITY,BRANCH_FILTER_ORDER);
+    if(branchLog_->capacity() != capacity || branchLog_->getHorizon() != FILTER_HISTORY_HORIZON) branchLog_->reset(capacity,FILTER_HISTORY_HORIZON);
+    branchLog_->push(stamp) = branches;
+
+    // 最新から FILTER_HISTORY_HORIZON 秒以内の検出のうち BRANCH_FILTER_TOLERANCE 以内に同じ分岐があった割合 (今回の分を含む) を持続性とする
+    for(auto&& b : branches){
+        int hits = 0;
+        int frames = 0;
+        branchLog_->forEachWithin(FILTER_HISTORY_HORIZON,[&](const std::vector<exploration_msgs::Branch>& log, double stamp){
+            ++frames;
+            for(const auto& l : log){
+                if(Eigen::Vector2d(b.point.x - l.point.x, b.point.y - l.point.y).norm() <= BRANCH_FILTER_TOLERANCE){
+                    ++hits;
+                    break;
+                }
+            }
+        });
+        b.confidence *= (double)hits / frames;
+    }
+}
+
 // void BranchDetection::branchFilter(std::vector<geometry_msgs::Point>& branches){
 void BranchDetection::branchFilter(std::vector<exploration_msgs::Branch>& branches){
     // static std::vector<std::vector<geometry_msgs::Point>> branchLog;
-    static std::vector<std::vector<exploration_msgs::Branch>> branchLog;
-    branchLog.emplace_back(branches);
-    if(branchLog.size()<BRANCH_FILTER_ORDER) return;
+    // 今回の分は branchConfidence で履歴に入れてある
+    if(branchLog_->size()<BRANCH_FILTER_ORDER) return;
 
     // 過去BRANCH_FILTER_ORDER個前までのデータに同じくらいのやつが出続けてないとだめ
     // 一個でもなかった時点で削除
     // branches.erase(std::remove_if(branches.begin(),branches.end(),[&,this](geometry_msgs::Point& p){
     branches.erase(std::remove_if(branches.begin(),branches.end(),[&,this](exploration_msgs::Branch& b){
-        for(int i=branchLog.size()-2,ie=i-(BRANCH_FILTER_ORDER-1);i!=ie;--i){
-            for(int j=0,je=branchLog[i].size();j!=je;++j){
-                if(Eigen::Vector2d(b.point.x - branchLog[i][j].point.x, b.point.y - branchLog[i][j].point.y).norm()>BRANCH_FILTER_TOLERANCE) return true;
+        for(int i=1;i!=BRANCH_FILTER_ORDER;++i){
+            for(const auto& l : branchLog_->at(i)){
+                if(Eigen::Vector2d(b.point.x - l.point.x, b.point.y - l.point.y).norm()>BRANCH_FILTER_TOLERANCE) return true;
             }
         }
         return false;
@@ -170,40 +257,65 @@ void BranchDetection::duplicateBranchDetection(std::vector<exploration_msgs::Bra
 	//重複探査の新しさとかはヘッダーの時間で見る
 	//重複が新しいときと古い時で挙動を変える
 	//重複探査を考慮する時間の上限から参照する配列の最大値を設定
-	int ARRAY_MAX = poseLog_->data.poses.size()-1;
-	for(int i=poseLog_->data.poses.size()-1;i!=0;--i){
-		if(ros::Duration(poseLog_->data.header.stamp - poseLog_->data.poses[i].header.stamp).toSec() > LOG_CURRENT_TIME){
+	const nav_msgs::Path& log = poseLog_->data;
+	updatePoseHash(log);
+	int ARRAY_MAX = log.poses.size()-1;
+	for(int i=log.poses.size()-1;i!=0;--i){
+		if(ros::Duration(log.header.stamp - log.poses[i].header.stamp).toSec() > LOG_CURRENT_TIME){
 			ARRAY_MAX = i;
 			break;
 		}
 	}
+    // 全てのログをたどらずに近くのセルの姿勢だけを調べる
+    // 範囲内で ARRAY_MAX 以前の一番新しい姿勢で新しい重複か古い重複かを決める (先頭の姿勢は見ない)
+    std::vector<int> indices;
     for(auto&& b : branches){
-        for(int i=ARRAY_MAX;i!=0;--i){
-            //過去のオドメトリが重複判定の範囲内に入っているか//
-            if(Eigen::Vector2d(b.point.x - poseLog_->data.poses[i].pose.position.x, b.point.y - poseLog_->data.poses[i].pose.position.y).norm() < DUPLICATE_TOLERANCE){
-                ROS_DEBUG_STREAM("This Branch is Duplicated");
-                b.status = ros::Duration(poseLog_->data.header.stamp - poseLog_->data.poses[i].header.stamp).toSec() > NEWER_DUPLICATION_THRESHOLD ? exploration_msgs::Branch::OLDER_DUPLICATION : exploration_msgs::Branch::NEWER_DUPLICATION;
-                break;
-            }
+        //過去のオドメトリが重複判定の範囲内に入っているか//
+        poseHash_->radiusSearch(Eigen::Vector2d(b.point.x, b.point.y),DUPLICATE_TOLERANCE,indices);
+        int newest = 0;
+        for(const auto& i : indices){
+            if(i <= ARRAY_MAX && i > newest) newest = i;
         }
+        if(newest == 0) continue;
+        ROS_DEBUG_STREAM("This Branch is Duplicated");
+        b.status = ros::Duration(log.header.stamp - log.poses[newest].header.stamp).toSec() > NEWER_DUPLICATION_THRESHOLD ? exploration_msgs::Branch::OLDER_DUPLICATION : exploration_msgs::Branch::NEWER_DUPLICATION;
 	}
 }
 
+void BranchDetection::updatePoseHash(const nav_msgs::Path& log){
+    // pose_log は後ろに追加されていくだけなので増えた分だけを入れる
+    // 減っていた時, 入れ済みの最初と最後の姿勢が変わっていた時 (最適化された pose_log など) と許容距離が変わった時は作り直す
+    auto same = [&log,this](int i){
+        return poseHash_->point(i) == Eigen::Vector2d(log.poses[i].pose.position.x, log.poses[i].pose.position.y);
+    };
+    const double cellSize = DUPLICATE_TOLERANCE > 0 ? DUPLICATE_TOLERANCE : 1.0;
+    const int n = poseHash_->size();
+    if(poseHash_->getCellSize() != cellSize) poseHash_->reset(cellSize);
+    else if((int)log.poses.size() < n || (n > 0 && (!same(0) || !same(n-1)))) poseHash_->clear();
+    for(int i=poseHash_->size(),ie=log.poses.size();i<ie;++i) poseHash_->insert(Eigen::Vector2d(log.poses[i].pose.position.x, log.poses[i].pose.position.y));
+}
+
 void BranchDetection::onMapBranchDetection(std::vector<exploration_msgs::Branch>& branches){
     // 分岐があり行ったことがない場所でも既に地図ができているところを検出する
     // パラメータで検索窓を作ってその窓の中で地図ができている割合が一定以上であれば地図ができているという判定にする
-    std::vector<std::vector<int8_t>> map2d = ExUtl::mapArray1dTo2d(map_->data.data,map_->data.info);
+    ExStc::GridView<const int8_t> map2d(ExStc::gridView(map_->data));
+
+    // 同じ地図に対しては積分画像を使いまわす, 窓の合計が地図より大きくなる時だけ作る
+    if(mapIntegral_->empty() || mapIntegralStamp_ != map_->data.header.stamp.toSec()){
+        mapIntegral_->clear();
+        const long windowCells = std::max(1,int(OMB_MAP_WINDOW_X/map_->data.info.resolution)) * std::max(1,int(OMB_MAP_WINDOW_Y/map_->data.info.resolution));
+        if(ExStc::mapIntegral::worthBuilding(branches.size(), windowCells, map2d.size())){
+            *mapIntegral_ = ExStc::mapIntegral(map2d);
+            mapIntegralStamp_ = map_->data.header.stamp.toSec();
+        }
+    }
+
     for(auto&& b : branches){
         if(b.status != exploration_msgs::Branch::NORMAL) continue;
         ExStc::mapSearchWindow msw(b.point,map_->data.info,OMB_MAP_WINDOW_X,OMB_MAP_WINDOW_Y);
-        int c = 0;
-        for(int y=msw.top,ey=msw.bottom+1;y!=ey;++y){
-            for(int x=msw.left,ex=msw.right+1;x!=ex;++x){
-                if(map2d[x][y] >= 0) ++c;
-            }
-        }
+        int c = mapIntegral_->empty() ? msw.knownCount(map2d) : msw.knownCount(*mapIntegral_);
         // ROS_DEBUG_STREAM("on map << c : " << c << ", width : " << msw.width << ", height : " << msw.height << ", ref rate : " << ON_MAP_BRANCH_RATE << ", calc rate : " << (double)c/(msw.width*msw.height) << ", map stamp : " << map_->data.header.stamp);
-        if((double)c/(msw.width*msw.height)>ON_MAP_BRANCH_RATE) b.status = exploration_msgs::Branch::ON_MAP;
+        if((double)c/msw.area()>ON_MAP_BRANCH_RATE) b.status = exploration_msgs::Branch::ON_MAP;
     }
 }
 
@@ -230,11 +342,16 @@ void BranchDetection::loadParams(void){
     nh.param<double>("branch_diff_x_max", BRANCH_DIFF_X_MAX, 10.0);
     nh.param<double>("branch_diff_y_min", BRANCH_DIFF_Y_MIN, 0.0);
     nh.param<double>("branch_diff_y_max", BRANCH_DIFF_Y_MAX, 10.0);
+    nh.param<int>("gap_scales", GAP_SCALES, 1);
+    nh.param<int>("gap_min_scales", GAP_MIN_SCALES, 1);
+    nh.param<double>("branch_confidence_min", BRANCH_CONFIDENCE_MIN, 0.0);
     nh.param<bool>("scan_filter", SCAN_FILTER, false);
     nh.param<int>("scan_filter_order", SCAN_FILTER_ORDER, 3);
     nh.param<bool>("branch_filter", BRANCH_FILTER, false);
     nh.param<int>("branch_filter_order", BRANCH_FILTER_ORDER, 3);
     nh.param<double>("branch_filter_tolerance", BRANCH_FILTER_TOLERANCE, 0.2);
+    nh.param<int>("filter_history_capacity", FILTER_HISTORY_CAPACITY, 10);
+    nh.param<double>("filter_history_horizon", FILTER_HISTORY_HORIZON, 5.0);
     nh.param<bool>("duplicate_detection", DUPLICATE_DETECTION, true);
     nh.param<double>("duplicate_tolerance", DUPLICATE_TOLERANCE, 1.5);
     nh.param<double>("log_current_time", LOG_CURRENT_TIME, 10);
@@ -257,11 +374,16 @@ void BranchDetection::dynamicParamsCB(exploration_support::branch_detection_para
     BRANCH_DIFF_X_MAX = cfg.branch_diff_x_max;
     BRANCH_DIFF_Y_MIN = cfg.branch_diff_y_min;
     BRANCH_DIFF_Y_MAX = cfg.branch_diff_y_max;
+    GAP_SCALES = cfg.gap_scales;
+    GAP_MIN_SCALES = cfg.gap_min_scales;
+    BRANCH_CONFIDENCE_MIN = cfg.branch_confidence_min;
     SCAN_FILTER = cfg.scan_filter;
     SCAN_FILTER_ORDER = cfg.scan_filter_order;
     BRANCH_FILTER = cfg.branch_filter;
     BRANCH_FILTER_ORDER = cfg.branch_filter_order;
     BRANCH_FILTER_TOLERANCE = cfg.branch_filter_tolerance;
+    FILTER_HISTORY_CAPACITY = cfg.filter_history_capacity;
+    FILTER_HISTORY_HORIZON = cfg.filter_history_horizon;
     DUPLICATE_DETECTION = cfg.duplicate_detection;
     DUPLICATE_TOLERANCE = cfg.duplicate_tolerance;
     LOG_CURRENT_TIME = cfg.log_current_time;
@@ -290,11 +412,16 @@ void BranchDetection::outputParams(void){
     ofs << "branch_diff_x_max: " << BRANCH_DIFF_X_MAX << std::endl;
     ofs << "branch_diff_y_min: " << BRANCH_DIFF_Y_MIN << std::endl;
     ofs << "branch_diff_y_max: " << BRANCH_DIFF_Y_MAX << std::endl;
+    ofs << "gap_scales: " << GAP_SCALES << std::endl;
+    ofs << "gap_min_scales: " << GAP_MIN_SCALES << std::endl;
+    ofs << "branch_confidence_min: " << BRANCH_CONFIDENCE_MIN << std::endl;
     ofs << "scan_filter: " << (SCAN_FILTER ? "true" : "false")<< std::endl;
     ofs << "scan_filter_order: " << SCAN_FILTER_ORDER << std::endl;
     ofs << "branch_filter: " << (BRANCH_FILTER  ? "true" : "false")<< std::endl;
     ofs << "branch_filter_order: " << BRANCH_FILTER_ORDER << std::endl;
     ofs << "branch_filter_tolerance: " << BRANCH_FILTER_TOLERANCE << std::endl;
+    ofs << "filter_history_capacity: " << FILTER_HISTORY_CAPACITY << std::endl;
+    ofs << "filter_history_horizon: " << FILTER_HISTORY_HORIZON << std::endl;
     ofs << "duplicate_detection: " << (DUPLICATE_DETECTION ? "true" : "false") << std::endl;
     ofs << "duplicate_tolerance: " << DUPLICATE_TOLERANCE << std::endl;
     ofs << "log_current_time: " << LOG_CURRENT_TIME << std::endl;
@@ -1,7 +1,13 @@
 #include <exploration_support/frontier_detection.h>
+#include <exploration_support/horizon_clustering.h>
+#include <exploration_support/horizon_kernel.h>
 #include <exploration_libraly/construct.h>
 #include <exploration_libraly/struct.h>
+#include <exploration_libraly/thread_pool.h>
 #include <exploration_msgs/FrontierArray.h>
+#include <exploration_msgs/FrontierDetectionStatus.h>
+#include <exploration_msgs/RobotInfoArray.h>
+#include <map_msgs/OccupancyGridUpdate.h>
 #include <nav_msgs/OccupancyGrid.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <exploration_libraly/utility.h>
@@ -9,28 +15,65 @@
 #include <exploration_support/frontier_detection_parameter_reconfigureConfig.h>
 #include <fstream>
 #include <Eigen/Core>
-#include <pcl/segmentation/extract_clusters.h>
+#include <climits>
+#include <numeric>
 #include <pcl_ros/point_cloud.h>
 
 namespace ExStc = ExpLib::Struct;
 namespace ExUtl = ExpLib::Utility;
 namespace ExCos = ExpLib::Construct;
 
+namespace{
+    double elapsed(const ros::WallTime& start){
+        return (ros::WallTime::now() - start).toSec();
+    }
+    // horizon をクラスタごとに塗り分ける色
+    const float HORIZON_COLORS[12][3] = {{255,0,0},{0,255,0},{0,0,255},{255,255,0},{0,255,255},{255,0,255},{127,255,0},{0,127,255},{127,0,255},{255,127,0},{0,255,127},{255,0,127}};
+}
+
 struct FrontierDetection::mapStruct{
     nav_msgs::MapMetaData info;
-    std::vector<std::vector<int8_t>> source;
-    std::vector<std::vector<int8_t>> horizon;
-    mapStruct(const nav_msgs::OccupancyGrid& m);
+    ExStc::GridView<int8_t> editable; // map_updates を適用する場合だけ地図をコピーして持つ
+    ExStc::GridView<const int8_t> source;
+    ExStc::mapIntegral integral; // 窓の中の既知セル, 障害物セルを数えるための積分画像, 窓の数が多い時だけ作る
+    int horizonWords; // horizon の一行あたりの要素数
+    std::vector<uint64_t> horizon; // horizon をビット単位で詰めたもの, HorizonKernel の形式
+    int horizonPoints; // horizon のセルの数, horizon を書き換える所で合わせて数え直す
+    mapStruct(const nav_msgs::OccupancyGridConstPtr& m, bool copy=false);
+    bool isHorizon(int x, int y) const {return HorizonKernel::test(horizon.data(),horizonWords,x,y);};
+    int horizonCount(int left, int top, int right, int bottom) const; // 範囲(両端を含む)の horizon のセルの数
 };
 
-FrontierDetection::mapStruct::mapStruct(const nav_msgs::OccupancyGrid& m)
-    :source(ExUtl::mapArray1dTo2d(m.data,m.info))
-    ,horizon(m.info.width,std::vector<int8_t>(m.info.height,0)){
-    info = m.info;
+FrontierDetection::mapStruct::mapStruct(const nav_msgs::OccupancyGridConstPtr& m, bool copy)
+    :info(m->info)
+    ,horizonWords(HorizonKernel::wordsPerRow(m->info.width))
+    ,horizon(horizonWords*m->info.height,0)
+    ,horizonPoints(0){
+    if(copy){
+        editable = ExStc::GridView<int8_t>(m->info.width,m->info.height,0);
+        std::copy(m->data.begin(),m->data.end(),editable.begin());
+        source = editable;
+    }
+    else source = ExStc::gridView(m);
+}
+
+int FrontierDetection::mapStruct::horizonCount(int left, int top, int right, int bottom) const {
+    int count = 0;
+    for(int y=top,ey=bottom+1;y<ey;++y){
+        for(int w=left>>6,ew=(right>>6)+1;w<ew;++w){
+            uint64_t bits = horizon[y*horizonWords+w];
+            if(w == left>>6) bits &= ~uint64_t(0) << (left&63);
+            if(w == right>>6) bits &= ~uint64_t(0) >> (63-(right&63));
+            count += __builtin_popcountll(bits);
+        }
+    }
+    return count;
 }
 
 struct FrontierDetection::clusterStruct{
+    std::vector<Eigen::Vector2i> cells; // horizon の二次元配列インデックス, pc と同じ順番
     std::vector<Eigen::Vector2i> index;
+    std::vector<Eigen::Vector4i> bounds; // 外接矩形の二次元配列インデックス (left, top, right, bottom)
     std::vector<int> isObstacle;
     std::vector<double> areas;
     std::vector<Eigen::Vector2d> variances;
@@ -41,10 +84,13 @@ struct FrontierDetection::clusterStruct{
     clusterStruct();
     clusterStruct(const clusterStruct& cs);
     void reserve(int size);
+    void append(const clusterStruct& cs, int i); // cs の i 番目のクラスタを統計値ごと追加
 };
 FrontierDetection::clusterStruct::clusterStruct():pc(new pcl::PointCloud<pcl::PointXYZ>){}
 FrontierDetection::clusterStruct::clusterStruct(const clusterStruct& cs)
-    :index(cs.index)
+    :cells(cs.cells)
+    ,index(cs.index)
+    ,bounds(cs.bounds)
     ,isObstacle(cs.isObstacle)
     ,areas(cs.areas)
     ,variances(cs.variances)
@@ -54,18 +100,234 @@ FrontierDetection::clusterStruct::clusterStruct(const clusterStruct& cs)
         
 void FrontierDetection::clusterStruct::reserve(int size){
     index.reserve(size);
+    bounds.reserve(size);
     isObstacle.reserve(size);
     areas.reserve(size);
     variances.reserve(size);
     covariance.reserve(size);
 }
 
+void FrontierDetection::clusterStruct::append(const clusterStruct& cs, int i){
+    pcl::PointIndices pi;
+    pi.indices.reserve(cs.indices[i].indices.size());
+    for(const auto& j : cs.indices[i].indices){
+        pi.indices.emplace_back(pc->points.size());
+        cells.emplace_back(cs.cells[j]);
+        pc->points.emplace_back(cs.pc->points[j]);
+    }
+    pc->width = pc->points.size();
+    pc->height = 1;
+    pc->is_dense = true;
+    indices.emplace_back(std::move(pi));
+    index.emplace_back(cs.index[i]);
+    bounds.emplace_back(cs.bounds[i]);
+    isObstacle.emplace_back(cs.isObstacle[i]);
+    areas.emplace_back(cs.areas[i]);
+    variances.emplace_back(cs.variances[i]);
+    covariance.emplace_back(cs.covariance[i]);
+}
+
+struct FrontierDetection::trackerStruct{
+    struct track{
+        uint32_t id;
+        uint32_t revision;
+        Eigen::Vector2d centroid; // 重心のセルの中心座標
+        Eigen::Vector4d bounds; // 外接矩形の座標 (left, bottom, right, top), map_merge で地図の原点や大きさが変わっても比べられるように座標で持つ
+        int size; // クラスタの点の数
+        uint8_t status;
+    };
+    std::vector<track> tracks; // 前回 publish した frontier
+    uint32_t nextId;
+
+    trackerStruct();
+    // 二次元配列インデックスは地図の原点や大きさが変わるとずれるので座標に直して比べる
+    static Eigen::Vector2d centroidOf(const Eigen::Vector2i& index, const nav_msgs::MapMetaData& info);
+    static Eigen::Vector4d boundsOf(const Eigen::Vector4i& bounds, const nav_msgs::MapMetaData& info);
+    // 外接矩形の重なり, 重心の距離で prev と一対一に対応させる, 対応が無ければ -1
+    static std::vector<int> match(const std::vector<track>& prev, const std::vector<Eigen::Vector2d>& centroids, const std::vector<Eigen::Vector4d>& bounds, double distance);
+    static bool unchanged(const track& a, const track& b){return a.centroid == b.centroid && a.bounds == b.bounds && a.size == b.size && a.status == b.status;};
+};
+FrontierDetection::trackerStruct::trackerStruct():nextId(0){}
+
+Eigen::Vector2d FrontierDetection::trackerStruct::centroidOf(const Eigen::Vector2i& index, const nav_msgs::MapMetaData& info){
+    const geometry_msgs::Point p = ExUtl::mapIndexToCoordinate(index.x(),index.y(),info);
+    return Eigen::Vector2d(p.x, p.y);
+}
+
+Eigen::Vector4d FrontierDetection::trackerStruct::boundsOf(const Eigen::Vector4i& bounds, const nav_msgs::MapMetaData& info){
+    // セルの端までを含める
+    const double res = info.resolution;
+    const Eigen::Vector2d origin(info.origin.position.x, info.origin.position.y);
+    return Eigen::Vector4d(origin.x() + bounds[0]*res, origin.y() + bounds[1]*res, origin.x() + (bounds[2]+1)*res, origin.y() + (bounds[3]+1)*res);
+}
+
+std::vector<int> FrontierDetection::trackerStruct::match(const std::vector<track>& prev, const std::vector<Eigen::Vector2d>& centroids, const std::vector<Eigen::Vector4d>& bounds, double distance){
+    auto iou = [](const Eigen::Vector4d& a, const Eigen::Vector4d& b){
+        const double w = std::min(a[2],b[2]) - std::max(a[0],b[0]);
+        const double h = std::min(a[3],b[3]) - std::max(a[1],b[1]);
+        if(w <= 0 || h <= 0) return 0.0;
+        const double inter = w * h;
+        return inter / ((a[2]-a[0])*(a[3]-a[1]) + (b[2]-b[0])*(b[3]-b[1]) - inter);
+    };
+
+    struct candidate{
+        int cur;
+        int prev;
+        double iou;
+        double distance;
+    };
+    std::vector<candidate> candidates;
+    for(int i=0,ie=centroids.size();i!=ie;++i){
+        for(int j=0,je=prev.size();j!=je;++j){
+            const double o = iou(bounds[i],prev[j].bounds);
+            const double d = (centroids[i] - prev[j].centroid).norm();
+            if(o > 0 || d <= distance) candidates.push_back({i,j,o,d});
+        }
+    }
+    // 重なりが大きい組, 重心が近い組から順番に一対一で対応させる
+    std::sort(candidates.begin(),candidates.end(),[](const candidate& a, const candidate& b){return a.iou != b.iou ? a.iou > b.iou : a.distance < b.distance;});
+
+    std::vector<int> matchOf(centroids.size(),-1);
+    std::vector<bool> used(prev.size(),false);
+    for(const auto& c : candidates){
+        if(matchOf[c.cur] >= 0 || used[c.prev]) continue;
+        matchOf[c.cur] = c.prev;
+        used[c.prev] = true;
+    }
+    return matchOf;
+}
+
+struct FrontierDetection::wavefrontStruct{
+    std::vector<uint32_t> visited; // 訪問した探索の番号, 毎回 0 で埋め直さなくて良いように番号で区別する
+    uint32_t generation;
+    std::vector<int> queue; // 幅優先探索のキュー (一次元配列インデックス), 容量を使いまわす
+
+    wavefrontStruct();
+};
+FrontierDetection::wavefrontStruct::wavefrontStruct():generation(0){}
+
+struct FrontierDetection::clusterCacheStruct{
+    struct cluster{
+        bool live;
+        std::vector<Eigen::Vector2i> cells; // horizon の二次元配列インデックス
+        Eigen::Vector2i index; // 重心のセル
+        Eigen::Vector4i bounds; // 外接矩形の二次元配列インデックス (left, top, right, bottom)
+        double area;
+        Eigen::Vector2d variance;
+        double covariance;
+        bool sized; // MIN_CLUSTER_SIZE 以上 MAX_CLUSTER_SIZE 以下
+        bool published; // frontier として publish している
+        exploration_msgs::Frontier frontier; // publish している frontier
+        trackerStruct::track track; // publish している frontier の追跡の記録
+        uint32_t visited; // overlapping で同じクラスタを二度返さないための探索の番号
+
+        cluster();
+    };
+    static const int BUCKET_CELLS = 32; // バケツの一辺のセル数
+    std::vector<cluster> clusters; // 消したクラスタの場所は使いまわすので番号は飛ぶ
+    std::vector<int> freeSlots;
+    int bucketsX;
+    int bucketsY;
+    std::vector<std::vector<int>> buckets; // 外接矩形が重なるクラスタの番号, 更新領域に近いクラスタだけを引くために使う
+    uint32_t generation;
+    int sizedCount; // sized なクラスタの数
+    std::vector<trackerStruct::track> lost; // 作り直しや判定のし直しで消えた frontier, 新しい frontier と対応を取って id を引き継ぐ
+
+    clusterCacheStruct(int width, int height);
+    int add(const clusterStruct& cs, int i, bool sized); // cs の i 番目のクラスタを追加して番号を返す
+    void remove(int id);
+    void overlapping(int left, int top, int right, int bottom, std::vector<int>& ids); // 外接矩形が範囲(両端を含む)に重なるクラスタの番号
+};
+FrontierDetection::clusterCacheStruct::cluster::cluster():live(false),area(0),covariance(0),sized(false),published(false),visited(0){}
+FrontierDetection::clusterCacheStruct::clusterCacheStruct(int width, int height)
+    :bucketsX((width + BUCKET_CELLS - 1) / BUCKET_CELLS)
+    ,bucketsY((height + BUCKET_CELLS - 1) / BUCKET_CELLS)
+    ,buckets(bucketsX*bucketsY)
+    ,generation(0)
+    ,sizedCount(0){}
+
+int FrontierDetection::clusterCacheStruct::add(const clusterStruct& cs, int i, bool sized){
+    int id;
+    if(freeSlots.empty()){
+        id = clusters.size();
+        clusters.emplace_back();
+    }
+    else{
+        id = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    cluster& c = clusters[id];
+    c.live = true;
+    c.cells.clear();
+    c.cells.reserve(cs.indices[i].indices.size());
+    for(const auto& j : cs.indices[i].indices) c.cells.emplace_back(cs.cells[j]);
+    c.index = cs.index[i];
+    c.bounds = cs.bounds[i];
+    c.area = cs.areas[i];
+    c.variance = cs.variances[i];
+    c.covariance = cs.covariance[i];
+    c.sized = sized;
+    c.published = false;
+    if(sized) ++sizedCount;
+    for(int by=c.bounds[1]/BUCKET_CELLS,eby=c.bounds[3]/BUCKET_CELLS;by<=eby;++by){
+        for(int bx=c.bounds[0]/BUCKET_CELLS,ebx=c.bounds[2]/BUCKET_CELLS;bx<=ebx;++bx) buckets[by*bucketsX+bx].emplace_back(id);
+    }
+    return id;
+}
+
+void FrontierDetection::clusterCacheStruct::remove(int id){
+    cluster& c = clusters[id];
+    for(int by=c.bounds[1]/BUCKET_CELLS,eby=c.bounds[3]/BUCKET_CELLS;by<=eby;++by){
+        for(int bx=c.bounds[0]/BUCKET_CELLS,ebx=c.bounds[2]/BUCKET_CELLS;bx<=ebx;++bx){
+            std::vector<int>& b = buckets[by*bucketsX+bx];
+            std::vector<int>::iterator it = std::find(b.begin(),b.end(),id);
+            if(it == b.end()) continue;
+            *it = b.back();
+            b.pop_back();
+        }
+    }
+    if(c.sized) --sizedCount;
+    c.live = false;
+    c.published = false;
+    c.cells.clear();
+    freeSlots.emplace_back(id);
+}
+
+void FrontierDetection::clusterCacheStruct::overlapping(int left, int top, int right, int bottom, std::vector<int>& ids){
+    ids.clear();
+    if(++generation == 0){
+        for(auto&& c : clusters) c.visited = 0;
+        generation = 1;
+    }
+    for(int by=std::max(0,top/BUCKET_CELLS),eby=std::min(bucketsY-1,bottom/BUCKET_CELLS);by<=eby;++by){
+        for(int bx=std::max(0,left/BUCKET_CELLS),ebx=std::min(bucketsX-1,right/BUCKET_CELLS);bx<=ebx;++bx){
+            for(const auto& id : buckets[by*bucketsX+bx]){
+                cluster& c = clusters[id];
+                if(c.visited == generation) continue;
+                c.visited = generation;
+                if(c.bounds[0] <= right && left <= c.bounds[2] && c.bounds[1] <= bottom && top <= c.bounds[3]) ids.emplace_back(id);
+            }
+        }
+    }
+}
+
 FrontierDetection::FrontierDetection()
     :map_(new ExStc::subStructSimple("map", 1, &FrontierDetection::mapCB, this))
+    ,robotArray_(new ExStc::subStruct<exploration_msgs::RobotInfoArray>("robot_array",1))
     ,frontier_(new ExStc::pubStruct<exploration_msgs::FrontierArray>("frontier",1,true))
     ,horizon_(new ExStc::pubStruct<sensor_msgs::PointCloud2>("horizon",1,true))
-    ,drs_(new dynamic_reconfigure::Server<exploration_support::frontier_detection_parameter_reconfigureConfig>(ros::NodeHandle("~/frontier"))){
+    ,status_(new ExStc::pubStruct<exploration_msgs::FrontierDetectionStatus>("frontier_detection_status",1))
+    ,statusMsg_(new exploration_msgs::FrontierDetectionStatus())
+    ,drs_(new dynamic_reconfigure::Server<exploration_support::frontier_detection_parameter_reconfigureConfig>(ros::NodeHandle("~/frontier")))
+    ,tracker_(new trackerStruct())
+    ,wavefront_(new wavefrontStruct())
+    ,horizonCloud_(new pcl::PointCloud<pcl::PointXYZRGB>)
+    ,horizonMsg_(new sensor_msgs::PointCloud2()){
     loadParams();
+    pool_.reset(new ExpLib::ThreadPool(WORKER_THREADS));
+    ROS_INFO_STREAM("horizon kernel : " << HorizonKernel::isaName(HorizonKernel::bestIsa()));
+    // map の remap 先に "_updates" を付けたトピックを購読する (map_server, costmap_2d と同じ命名)
+    if(USE_MAP_UPDATES) mapUpdate_.reset(new ExStc::subStructSimple(ros::names::resolve("map") + "_updates", 10, &FrontierDetection::mapUpdateCB, this));
     drs_->setCallback(boost::bind(&FrontierDetection::dynamicParamsCB,this, _1, _2));
 }
 
@@ -74,26 +336,186 @@ FrontierDetection::~FrontierDetection(){
 }
 
 void FrontierDetection::mapCB(const nav_msgs::OccupancyGridConstPtr& msg){
+    *statusMsg_ = exploration_msgs::FrontierDetectionStatus();
+    statusMsg_->map_stamp = msg->header.stamp;
+    statusMsg_->incremental = false;
+    ros::WallTime start = ros::WallTime::now();
+
     // map の取り込み
-    mapStruct map(*msg);
-    horizonDetection(map);
+    if(USE_MAP_UPDATES){
+        // 差分更新用に地図とクラスタを保持しておく
+        mapCache_.reset(new mapStruct(msg,true));
+        statusMsg_->map_conversion = elapsed(start);
+
+        cachedFrontierDetection(*mapCache_, msg->header.frame_id);
+        return;
+    }
+    mapStruct map(msg);
+    statusMsg_->map_conversion = elapsed(start);
+
+    clusterStruct cluster(horizonClustering(map));
+    std::vector<exploration_msgs::Frontier> frontiers;
+    std::vector<int> clusterOf;
+    frontierDetection(map, cluster, msg->header.frame_id, frontiers, clusterOf);
+}
+
+void FrontierDetection::mapUpdateCB(const map_msgs::OccupancyGridUpdateConstPtr& msg){
+    if(!mapCache_){
+        ROS_WARN_STREAM("received map update, but don't have any full map to update");
+        return;
+    }
+    if(msg->x < 0 || msg->y < 0){
+        ROS_ERROR_STREAM("negative coordinates, invalid update. x: " << msg->x << ", y: " << msg->y);
+        return;
+    }
+    if(msg->data.size() < (size_t)msg->width * msg->height){
+        ROS_ERROR_STREAM("map update data is too short, invalid update. width: " << msg->width << ", height: " << msg->height << ", data size: " << msg->data.size());
+        return;
+    }
+
+    *statusMsg_ = exploration_msgs::FrontierDetectionStatus();
+    statusMsg_->map_stamp = msg->header.stamp;
+    statusMsg_->incremental = true;
+    ros::WallTime start = ros::WallTime::now();
+
+    mapStruct& map = *mapCache_;
+    const int x0 = msg->x;
+    const int y0 = msg->y;
+    const int xn = std::min(x0 + (int)msg->width, (int)map.info.width);
+    const int yn = std::min(y0 + (int)msg->height, (int)map.info.height);
+
+    if(x0 >= xn || y0 >= yn){
+        ROS_WARN_STREAM("received map update doesn't fit into existing map");
+        return;
+    }
+
+    // 更新領域を書き込む
+    for(int y=y0;y!=yn;++y){
+        std::vector<int8_t>::const_iterator it = msg->data.begin() + (y-y0)*msg->width;
+        std::copy(it,it+(xn-x0),map.editable.row(y)+x0);
+    }
+
+    // 積分画像は地図が変わると使えない
+    map.integral.clear();
+    statusMsg_->map_conversion = elapsed(start);
+
+    // dynamic_reconfigure でクラスタや判定のパラメータが変わった後は全体をやり直す
+    // wavefront は局所的な更新でもたどり着ける範囲が大きく変わるので毎回全体をやり直す
+    if(!clusterCache_ || WAVEFRONT_DETECTION){
+        cachedFrontierDetection(map, msg->header.frame_id);
+        return;
+    }
+
+    incrementalFrontierDetection(map, x0, y0, xn-1, yn-1, msg->header.frame_id);
+}
+
+void FrontierDetection::cachedFrontierDetection(mapStruct& map, const std::string& frameId){
+    // 地図全体からやり直し, 差分更新で使うクラスタと frontier を clusterCache_ に持っておく
+    // clusterCache_ は大きさで捨てずに全ての horizon をクラスタとして持つ
+    clusterStruct all(horizonClustering(map,true));
+    clusterStruct cluster(clusterSizeFilter(all));
+    std::vector<exploration_msgs::Frontier> frontiers;
+    std::vector<int> clusterOf;
+    frontierDetection(map, cluster, frameId, frontiers, clusterOf);
+
+    // clusterSizeFilter は並び順を変えないので, all の中で大きさの条件を満たす k 番目のクラスタが cluster の k 番目
+    // frontierTracking は frontier と同じ順番で tracks を作る
+    std::vector<int> frontierOf(cluster.indices.size(),-1);
+    for(int f=0,fe=clusterOf.size();f!=fe;++f) frontierOf[clusterOf[f]] = f;
+    clusterCache_.reset(new clusterCacheStruct(map.info.width,map.info.height));
+    for(int i=0,k=0,ie=all.indices.size();i!=ie;++i){
+        const int size = all.indices[i].indices.size();
+        const bool sized = MIN_CLUSTER_SIZE <= size && size <= MAX_CLUSTER_SIZE;
+        clusterCacheStruct::cluster& c = clusterCache_->clusters[clusterCache_->add(all,i,sized)];
+        if(!sized) continue;
+        const int f = frontierOf[k++];
+        if(f < 0) continue;
+        c.published = true;
+        c.frontier = frontiers[f];
+        c.frontier.tracking = exploration_msgs::Frontier::UNCHANGED;
+        c.track = tracker_->tracks[f];
+    }
+}
+
+void FrontierDetection::incrementalFrontierDetection(mapStruct& map, int left, int top, int right, int bottom, const std::string& frameId){
+    // 更新領域(両端を含む)の影響を受ける horizon, クラスタ, frontier だけを作り直し, それ以外は clusterCache_ に持っている前回の結果を使う
+    // horizon は隣接セルで決まるので更新領域の1セル外側まで再計算
+    ros::WallTime start = ros::WallTime::now();
+    horizonDetection(map, left-1, top-1, right+1, bottom+1);
+    statusMsg_->horizon_detection = elapsed(start);
+
+    // 変化した horizon とクラスタ許容距離以内にあるクラスタのみ作り直す
+    start = ros::WallTime::now();
+    const int margin = 1 + std::ceil(CLUSTER_TOLERANCE / map.info.resolution);
+    std::vector<int> added;
+    clusterUpdate(map, left-margin, top-margin, right+margin, bottom+margin, added);
+    statusMsg_->clustering = elapsed(start);
+
+    std::vector<uint32_t> removedIds;
+    frontierUpdate(map, left, top, right, bottom, added, removedIds);
+
+    // publish する frontier を集める, 今回判定しなかった frontier は次の更新まで UNCHANGED になる
+    start = ros::WallTime::now();
+    std::vector<exploration_msgs::Frontier> frontiers;
+    std::vector<trackerStruct::track> tracks;
+    for(auto&& c : clusterCache_->clusters){
+        if(!c.live || !c.published) continue;
+        frontiers.emplace_back(c.frontier);
+        tracks.emplace_back(c.track);
+        c.frontier.tracking = exploration_msgs::Frontier::UNCHANGED;
+    }
+    // 地図全体をやり直す時に今の frontier と対応を取れるようにしておく
+    tracker_->tracks.swap(tracks);
+
+    statusMsg_->clusters = clusterCache_->sizedCount;
+    statusMsg_->horizon_points = map.horizonPoints;
+    statusMsg_->frontiers = frontiers.size();
+    if(frontiers.empty()) ROS_INFO_STREAM("Frontier Do Not Found");
+    else ROS_INFO_STREAM("Frontier Found : " << frontiers.size());
+
+    publishHorizon(map, *clusterCache_, frameId);
+    publishFrontier(frontiers, removedIds, frameId);
+    statusMsg_->publish = elapsed(start);
+    publishStatus();
+}
+
+void FrontierDetection::frontierDetection(mapStruct& map, clusterStruct& cluster, const std::string& frameId, std::vector<exploration_msgs::Frontier>& frontiers, std::vector<int>& clusterOf){
+    ros::WallTime start = ros::WallTime::now();
+    // 窓の中を数える処理の合計が地図全体より大きい時は積分画像を作って窓ごとに O(1) で数える
+    if(map.integral.empty()){
+        const long filterDiameter = std::max(1,int(FILTER_SQUARE_DIAMETER/map.info.resolution));
+        const long filterCells = filterDiameter * filterDiameter;
+        const long omfCells = ON_MAP_FRONTIER_DETECTION ? std::max(1,int(OMF_MAP_WINDOW_X/map.info.resolution)) * std::max(1,int(OMF_MAP_WINDOW_Y/map.info.resolution)) : 0;
+        if(ExStc::mapIntegral::worthBuilding(cluster.index.size(), filterCells + omfCells, map.source.size())) map.integral = ExStc::mapIntegral(map.source);
+    }
 
-    clusterStruct cluster(clusterDetection(map));
     obstacleFilter(map,cluster);
+    statusMsg_->obstacle_filter = elapsed(start);
+
+    statusMsg_->clusters = cluster.index.size();
+    statusMsg_->horizon_points = map.horizonPoints;
 
+    frontiers.clear();
+    clusterOf.clear();
     if(cluster.index.size() == 0){
         ROS_INFO_STREAM("Frontier Do Not Found");
-        publishFrontier(std::vector<exploration_msgs::Frontier>(), msg->header.frame_id);
+        std::vector<uint32_t> removedIds;
+        frontierTracking(map, cluster, clusterOf, frontiers, removedIds);
+        start = ros::WallTime::now();
+        publishFrontier(frontiers, removedIds, frameId);
+        statusMsg_->publish = elapsed(start);
+        publishStatus();
         return;
     }
-    //ここでクラスタ表示したい
-    publishHorizon(cluster, msg->header.frame_id);
-    std::vector<exploration_msgs::Frontier> frontiers;
+    start = ros::WallTime::now();
+    // clusterOf は frontier の元になったクラスタの番号
     frontiers.reserve(cluster.index.size());
+    clusterOf.reserve(cluster.index.size());
 
     for(int i=0,e=cluster.index.size();i!=e;++i){
         // if(cluster.index[i].z() == 0) continue;
         if(cluster.isObstacle[i] == 0) continue;
+        clusterOf.emplace_back(i);
         frontiers.emplace_back(ExCos::msgFrontier(ExUtl::mapIndexToCoordinate(cluster.index[i].x(),cluster.index[i].y(),map.info),cluster.areas[i],ExCos::msgVector(cluster.variances[i].x(),cluster.variances[i].y()),cluster.covariance[i]));
     }
 
@@ -101,152 +523,457 @@ void FrontierDetection::mapCB(const nav_msgs::OccupancyGridConstPtr& msg){
     if(ON_MAP_FRONTIER_DETECTION) onMapFrontierDetection(map, frontiers);
     //useful
     usefulFrontierDetection(frontiers);
+    //tracking
+    std::vector<uint32_t> removedIds;
+    frontierTracking(map, cluster, clusterOf, frontiers, removedIds);
+    statusMsg_->classification = elapsed(start);
+    statusMsg_->frontiers = frontiers.size();
 
     ROS_INFO_STREAM("Frontier Found : " << frontiers.size());
 
-    publishFrontier(frontiers, msg->header.frame_id);
+    start = ros::WallTime::now();
+    //ここでクラスタ表示したい
+    publishHorizon(cluster, frameId);
+    publishFrontier(frontiers, removedIds, frameId);
+    statusMsg_->publish = elapsed(start);
+    publishStatus();
 }
 
-void FrontierDetection::horizonDetection(mapStruct& map){
-    ROS_INFO_STREAM("Horizon Detection");
+FrontierDetection::clusterStruct FrontierDetection::horizonClustering(mapStruct& map, bool allSizes){
+    // 地図全体の horizon, またはロボットの位置からたどり着ける horizon を求めてクラスタリングする
+    ros::WallTime start = ros::WallTime::now();
+    std::vector<int> seeds;
+    if(!WAVEFRONT_DETECTION || !wavefrontSeeds(map, seeds)){
+        horizonDetection(map);
+        statusMsg_->horizon_detection = elapsed(start);
 
-    auto isHorizon = [](int8_t free, int8_t unknown){
-        // return free == 0 && unknown ==-1;
-        return (0 <= free && free < 99) && unknown == -1;
-    };
+        start = ros::WallTime::now();
+        clusterStruct cs(clusterDetection(map,allSizes));
+        statusMsg_->clustering = elapsed(start);
+        return cs;
+    }
+    statusMsg_->wavefront = true;
+    clusterStruct cs;
+    wavefrontDetection(map, seeds, cs);
+    statusMsg_->horizon_detection = elapsed(start);
+
+    start = ros::WallTime::now();
+    clusterDetection(map, cs, allSizes);
+    statusMsg_->clustering = elapsed(start);
+    return cs;
+}
 
-    //x axis horizon
-    for(int y=0,ey=map.info.height;y!=ey;++y){
-        for(int x=0,ex=map.info.width-1;x!=ex;++x){
-            // if(map.source[x][y] == 0 && map.source[x+1][y] == -1) map.horizon[x][y] = 1;
-            // else if(map.source[x][y] == -1 && map.source[x+1][y] == 0) map.horizon[x+1][y] = 1;
-            if(isHorizon(map.source[x][y], map.source[x+1][y])) map.horizon[x][y] = 1;
-            else if(isHorizon(map.source[x+1][y], map.source[x][y])) map.horizon[x+1][y] = 1;
+bool FrontierDetection::wavefrontSeeds(const mapStruct& map, std::vector<int>& seeds){
+    // 各ロボットの位置から WAVEFRONT_SEED_RADIUS 以内で一番近い自由領域のセルを探索の起点にする
+    // 地図ごとに待たないように届いている robot_array だけを読む
+    robotArray_->q.callAvailable();
+    if(robotArray_->data.info.empty()){
+        ROS_WARN_STREAM("Can't read robot_array or don't find robot_array, detect horizon from whole map");
+        return false;
+    }
+
+    const int width = map.info.width;
+    const int height = map.info.height;
+    const int r = WAVEFRONT_SEED_RADIUS / map.info.resolution;
+    for(const auto& robot : robotArray_->data.info){
+        const Eigen::Vector2i c = ExUtl::coordinateToMapIndex(robot.pose.position,map.info);
+        int seed = -1;
+        int nearest = INT_MAX;
+        for(int y=std::max(0,c.y()-r),ey=std::min(height-1,c.y()+r);y<=ey;++y){
+            for(int x=std::max(0,c.x()-r),ex=std::min(width-1,c.x()+r);x<=ex;++x){
+                const int d = (x-c.x())*(x-c.x()) + (y-c.y())*(y-c.y());
+                if(d < nearest && d <= r*r && HorizonKernel::isFree(map.source(x,y))){
+                    seed = y*width + x;
+                    nearest = d;
+                }
+            }
         }
+        if(seed >= 0) seeds.emplace_back(seed);
+        else ROS_WARN_STREAM(robot.name << " is not on free space of the map");
+    }
+    if(seeds.empty()) ROS_WARN_STREAM("No robot is on free space of the map, detect horizon from whole map");
+    return !seeds.empty();
+}
+
+void FrontierDetection::wavefrontDetection(mapStruct& map, const std::vector<int>& seeds, clusterStruct& cs){
+    // ロボットの位置から自由領域を幅優先探索して, たどり着ける horizon だけを取り出す (wavefront frontier detection)
+    // 到達できない領域や未知領域の向こう側は見ないので, 探索済みの自由領域の広さに比例した時間で済む
+    // 壁は斜めにつながったセルの線になっていることが多いので, すり抜けないように上下左右にだけ広げる
+    ROS_INFO_STREAM("Wavefront Horizon Detection");
+    const int width = map.info.width;
+    const int height = map.info.height;
+    const int8_t* data = map.source.data;
+    wavefrontStruct& wf = *wavefront_;
+    if(wf.visited.size() != map.source.size() || wf.generation == UINT32_MAX){
+        wf.visited.assign(map.source.size(),0);
+        wf.generation = 0;
     }
+    const uint32_t g = ++wf.generation;
+
+    // map_updates で使いまわしている地図には前回の horizon が残っている
+    std::fill(map.horizon.begin(),map.horizon.end(),0);
 
-    //y axis horizon
-    for(int x=0,ex=map.info.width;x!=ex;++x){
-        for(int y=0,ey=map.info.height-1;y!=ey;++y){
-            // if(map.source[x][y] == 0 && map.source[x][y+1] == -1) map.horizon[x][y] = 1;
-            // else if(map.source[x][y] == -1 && map.source[x][y+1] == 0) map.horizon[x][y+1] = 1;
-            if(isHorizon(map.source[x][y], map.source[x][y+1])) map.horizon[x][y] = 1;
-            else if(isHorizon(map.source[x][y+1], map.source[x][y])) map.horizon[x][y+1] = 1;
+    wf.queue.clear();
+    for(const auto& s : seeds){
+        if(wf.visited[s] == g) continue;
+        wf.visited[s] = g;
+        wf.queue.emplace_back(s);
+    }
+    auto push = [&](int i){
+        if(wf.visited[i] == g || !HorizonKernel::isFree(data[i])) return;
+        wf.visited[i] = g;
+        wf.queue.emplace_back(i);
+    };
+    for(size_t head=0;head<wf.queue.size();++head){
+        const int i = wf.queue[head];
+        const int x = i % width;
+        const int y = i / width;
+        if(HorizonKernel::isHorizon(data,width,height,x,y)){
+            map.horizon[y*map.horizonWords + (x>>6)] |= uint64_t(1) << (x&63);
+            cs.cells.emplace_back(x,y);
         }
+        if(x > 0) push(i-1);
+        if(x < width-1) push(i+1);
+        if(y > 0) push(i-width);
+        if(y < height-1) push(i+width);
     }
+    map.horizonPoints = cs.cells.size();
+    statusMsg_->reachable_cells = wf.queue.size();
+    ROS_INFO_STREAM("Wavefront Horizon Detection complete\n");
+}
+
+void FrontierDetection::horizonDetection(mapStruct& map){
+    ROS_INFO_STREAM("Horizon Detection");
+    // 自由領域のセルのうち上下左右のどれかが未知領域のもの
+    // 行ごとに独立しているので行方向の帯に分けて並列に求める
+    const int height = map.info.height;
+    const int bh = HorizonKernel::bandHeight(height, pool_->size());
+    const int bands = (height + bh - 1) / bh;
+    const HorizonKernel::Isa isa = HorizonKernel::bestIsa();
+    std::vector<int> counts(bands,0);
+    pool_->parallelFor(0, bands, [&](int t){
+        const int top = t*bh;
+        const int bottom = std::min(height,(t+1)*bh);
+        HorizonKernel::horizonRows(map.source.data,map.info.width,height,top,bottom,map.horizon.data(),isa);
+        for(int k=top*map.horizonWords,ke=bottom*map.horizonWords;k!=ke;++k) counts[t] += __builtin_popcountll(map.horizon[k]);
+    });
+    map.horizonPoints = std::accumulate(counts.begin(),counts.end(),0);
     ROS_INFO_STREAM("Horizon Detection complete\n");
 }
 
-FrontierDetection::clusterStruct FrontierDetection::clusterDetection(const mapStruct& map){
-    
-    ROS_INFO_STREAM("Frontier Detection by Clustering");
+void FrontierDetection::horizonDetection(mapStruct& map, int left, int top, int right, int bottom){
+    // 指定範囲(両端を含む)の horizon を作り直す, horizon のセルの数は範囲の中の増減だけを足す
+    left = std::max(left, 0);
+    top = std::max(top, 0);
+    right = std::min(right, (int)map.info.width-1);
+    bottom = std::min(bottom, (int)map.info.height-1);
+    if(left > right || top > bottom) return;
 
-    std::vector<geometry_msgs::Point> points;
-    points.reserve(map.info.height*map.info.width);
-    for(int y=0,ey=map.info.height;y!=ey;++y){
-        for(int x=0,ex=map.info.width;x!=ex;++x){
-            if(map.horizon[x][y] == 1) points.emplace_back(ExUtl::mapIndexToCoordinate(x,y,map.info));
+    map.horizonPoints -= map.horizonCount(left,top,right,bottom);
+    for(int y=top,ey=bottom+1;y<ey;++y) HorizonKernel::horizonRow(map.source.data,map.info.width,map.info.height,y,left,right,map.horizon.data());
+    map.horizonPoints += map.horizonCount(left,top,right,bottom);
+}
+
+FrontierDetection::clusterStruct FrontierDetection::clusterDetection(const mapStruct& map, bool allSizes){
+    clusterStruct cs;
+    // 立っているビットだけを順番に取り出す, 帯ごとに並列に取り出して最後につなげる
+    const int height = map.info.height;
+    const int bh = HorizonKernel::bandHeight(height, pool_->size());
+    const int bands = (height + bh - 1) / bh;
+    std::vector<std::vector<Eigen::Vector2i>> bandCells(bands);
+    pool_->parallelFor(0, bands, [&](int t){
+        for(int y=t*bh,ey=std::min(height,(t+1)*bh);y<ey;++y){
+            for(int w=0;w!=map.horizonWords;++w){
+                for(uint64_t bits=map.horizon[y*map.horizonWords+w];bits!=0;bits&=bits-1) bandCells[t].emplace_back((w<<6)+__builtin_ctzll(bits),y);
+            }
         }
+    });
+    if(bands == 1) cs.cells.swap(bandCells.front());
+    else{
+        size_t size = 0;
+        for(const auto& b : bandCells) size += b.size();
+        cs.cells.reserve(size);
+        for(const auto& b : bandCells) cs.cells.insert(cs.cells.end(),b.begin(),b.end());
     }
+    clusterDetection(map, cs, allSizes);
+    return cs;
+}
 
-    clusterStruct cs;
-    cs.pc -> points.reserve(points.size());
+void FrontierDetection::clusterDetection(const mapStruct& map, clusterStruct& cs, bool allSizes){
+    // cs.cells に入っている horizon をクラスタリングして統計値を求める
+    // allSizes なら MIN_CLUSTER_SIZE, MAX_CLUSTER_SIZE で捨てずに全てのクラスタを残す
+    ROS_INFO_STREAM("Frontier Detection by Clustering");
 
-    for(const auto& p : points) cs.pc -> points.emplace_back(pcl::PointXYZ((float)p.x,(float)p.y,0.0f));
+    // 格子でのクラスタリングは y, x の順に並んでいることを前提にする
+    auto rowMajor = [](const Eigen::Vector2i& a, const Eigen::Vector2i& b){return a.y() < b.y() || (a.y() == b.y() && a.x() < b.x());};
+    if(GRID_CLUSTERING && !std::is_sorted(cs.cells.begin(),cs.cells.end(),rowMajor)) std::sort(cs.cells.begin(),cs.cells.end(),rowMajor);
+
+    cs.pc -> points.reserve(cs.cells.size());
+
+    for(const auto& c : cs.cells){
+        geometry_msgs::Point p = ExUtl::mapIndexToCoordinate(c.x(),c.y(),map.info);
+        cs.pc -> points.emplace_back(pcl::PointXYZ((float)p.x,(float)p.y,0.0f));
+    }
 
     cs.pc -> width = cs.pc -> points.size();
     cs.pc -> height = 1;
     cs.pc -> is_dense = true;
 
-    pcl::search::KdTree<pcl::PointXYZ>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZ>);
-    tree->setInputCloud (cs.pc);
+    if(cs.pc -> points.empty()) return;
 
-    pcl::EuclideanClusterExtraction<pcl::PointXYZ> ec;
-    ec.setClusterTolerance (CLUSTER_TOLERANCE);//同じクラスタとみなす距離
-  	ec.setMinClusterSize (MIN_CLUSTER_SIZE);//クラスタを構成する最小の点数
-  	ec.setMaxClusterSize (MAX_CLUSTER_SIZE);//クラスタを構成する最大の点数
-	ec.setSearchMethod (tree);
-	ec.setInputCloud (cs.pc);
+    const int minSize = allSizes ? 1 : MIN_CLUSTER_SIZE;
+    const int maxSize = allSizes ? INT_MAX : MAX_CLUSTER_SIZE;
+    std::vector<HorizonClustering::moment> moments;
+    if(GRID_CLUSTERING) HorizonClustering::grid(cs.cells, map.info, CLUSTER_TOLERANCE, minSize, maxSize, *pool_, cs.indices, moments);
+    else HorizonClustering::euclidean(cs.cells, cs.pc, CLUSTER_TOLERANCE, minSize, maxSize, cs.indices, moments);
 
-	ec.extract (cs.indices);
-    cs.reserve(cs.indices.size());
+    cs.reserve(moments.size());
+    for(const auto& m : moments){
+        cs.variances.emplace_back(m.variance(map.info.resolution));
+        cs.covariance.emplace_back(m.covariance(map.info.resolution));
+        cs.index.emplace_back(ExUtl::coordinateToMapIndex(m.centroid(map.info),map.info));
+        cs.bounds.emplace_back(m.bounds);
+        cs.isObstacle.emplace_back(1);
+        cs.areas.emplace_back(m.area(map.info.resolution));
+    }
+}
+
+FrontierDetection::clusterStruct FrontierDetection::clusterSizeFilter(const clusterStruct& cs){
+    // 大きさで捨てずに持っているクラスタから MIN_CLUSTER_SIZE 以上 MAX_CLUSTER_SIZE 以下のものを取り出す
+    // 並び順は cs のまま
+    clusterStruct filtered;
+    filtered.reserve(cs.indices.size());
+    for(int i=0,ie=cs.indices.size();i!=ie;++i){
+        const int size = cs.indices[i].indices.size();
+        if(MIN_CLUSTER_SIZE <= size && size <= MAX_CLUSTER_SIZE) filtered.append(cs,i);
+    }
+    return filtered;
+}
 
-    for (std::vector<pcl::PointIndices>::const_iterator it = cs.indices.begin (); it != cs.indices.end (); ++it){
-        Eigen::Vector2d sum(0,0);
-        Eigen::Vector2d max(-DBL_MAX,-DBL_MAX);
-        Eigen::Vector2d min(DBL_MAX,DBL_MAX);
+void FrontierDetection::clusterUpdate(const mapStruct& map, int left, int top, int right, int bottom, std::vector<int>& added){
+    // 指定範囲(両端を含む)に点を持つクラスタと範囲内の horizon だけをクラスタリングし直し, それ以外のクラスタはそのまま残す
+    // clusterCache_ は大きさで捨てずに全ての horizon を持っているので, 範囲外の horizon は必ずどれかのクラスタに入っている
+    // 範囲に点を持たないクラスタは変化した horizon から許容距離より離れているので全体をやり直した時と同じ結果になる
+    // 範囲に重なるクラスタはバケツから引くので, 手間は地図全体のクラスタの数ではなく範囲の近くのクラスタの大きさで決まる
+    left = std::max(left, 0);
+    top = std::max(top, 0);
+    right = std::min(right, (int)map.info.width-1);
+    bottom = std::min(bottom, (int)map.info.height-1);
 
-        for (std::vector<int>::const_iterator pit = it->indices.begin (); pit != it->indices.end (); ++pit){
-            sum.x() += cs.pc -> points[*pit].x;
-            sum.y() += cs.pc -> points[*pit].y;
+    auto inside = [&](const Eigen::Vector2i& c){return left <= c.x() && c.x() <= right && top <= c.y() && c.y() <= bottom;};
 
-            if(cs.pc -> points[*pit].x > max.x()) max.x() = cs.pc -> points[*pit].x;
-            else if(cs.pc -> points[*pit].x < min.x()) min.x() = cs.pc -> points[*pit].x;
+    clusterCacheStruct& cache = *clusterCache_;
+    cache.lost.clear();
+    std::vector<int> candidates;
+    cache.overlapping(left, top, right, bottom, candidates);
 
-            if(cs.pc -> points[*pit].y > max.y()) max.y() = cs.pc -> points[*pit].y;
-            else if(cs.pc -> points[*pit].y < min.y()) min.y() = cs.pc -> points[*pit].y;
+    clusterStruct sub;
+    int rebuilt = 0;
+    for(const auto& id : candidates){
+        clusterCacheStruct::cluster& c = cache.clusters[id];
+        if(std::none_of(c.cells.begin(),c.cells.end(),inside)) continue;
+        // 範囲外の点は horizon が変化していないのでそのまま使う
+        for(const auto& p : c.cells){
+            if(!inside(p)) sub.cells.emplace_back(p);
         }
-        Eigen::Vector2d centroid(sum.x()/it->indices.size(),sum.y()/it->indices.size());
-        Eigen::Vector2d variance(0,0);
-        double covariance = 0;
-        //分散を求めたい
-        for (std::vector<int>::const_iterator pit = it->indices.begin (); pit != it->indices.end (); ++pit){
-            variance.x() += (cs.pc -> points[*pit].x - centroid.x()) * (cs.pc -> points[*pit].x - centroid.x());
-            variance.y() += (cs.pc -> points[*pit].y - centroid.y()) * (cs.pc -> points[*pit].y - centroid.y());
-            covariance += (cs.pc -> points[*pit].x - centroid.x()) * (cs.pc -> points[*pit].y - centroid.y());
+        if(c.published) cache.lost.emplace_back(c.track);
+        cache.remove(id);
+        ++rebuilt;
+    }
+    for(int y=top,ey=bottom+1;y<ey;++y){
+        for(int x=left,ex=right+1;x<ex;++x){
+            if(map.isHorizon(x,y)) sub.cells.emplace_back(x,y);
         }
+    }
 
-        variance /= it->indices.size();
-        covariance /= it->indices.size();
+    clusterDetection(map, sub, true);
 
-        cs.variances.emplace_back(variance);
-        cs.covariance.emplace_back(covariance/sqrt(variance.x())/sqrt(variance.y()));
-        cs.index.emplace_back(ExUtl::coordinateToMapIndex(std::move(centroid),map.info));
-        cs.isObstacle.emplace_back(1);
-        Eigen::Vector2d diff(max-min);
-        cs.areas.emplace_back(std::abs(diff.x()*diff.y()));
+    added.clear();
+    added.reserve(sub.indices.size());
+    for(int i=0,ie=sub.indices.size();i!=ie;++i){
+        const int size = sub.indices[i].indices.size();
+        added.emplace_back(cache.add(sub,i,MIN_CLUSTER_SIZE <= size && size <= MAX_CLUSTER_SIZE));
     }
 
-    return cs;
+    ROS_INFO_STREAM("Cluster Update : " << rebuilt << " clusters rebuilt from " << sub.cells.size() << " points");
 }
 
-void FrontierDetection::obstacleFilter(FrontierDetection::mapStruct& map,clusterStruct& cs){
+void FrontierDetection::frontierUpdate(const mapStruct& map, int left, int top, int right, int bottom, const std::vector<int>& added, std::vector<uint32_t>& removedIds){
+    // 作り直したクラスタと, 障害物判定や地図ができているかを見る窓が更新領域(両端を含む)に掛かるクラスタだけを判定し直す
+    // 判定し直した frontier だけを clusterUpdate で消えた frontier と対応させて id を引き継ぐ
     ROS_INFO_STREAM("Obstacle Filter");
-    
-    for(int i=0,ie=cs.index.size();i!=ie;++i){
-        ExStc::mapSearchWindow msw(cs.index[i].x(),cs.index[i].y(),map.info.width,map.info.height,FILTER_SQUARE_DIAMETER/map.info.resolution);
-        for(int y=msw.top,ey=msw.bottom+1;y!=ey;++y){
-            for(int x=msw.left,ex=msw.right+1;x!=ex;++x){
-                if(map.source[x][y] == 100){//障害部があったら終了
-                    cs.isObstacle[i] = 0;
-                    x = ex -1;//ラムダで関数作ってreturnで終わっても良いかも
-                    y = ey -1;
-                }
-            }
+    ros::WallTime start = ros::WallTime::now();
+    clusterCacheStruct& cache = *clusterCache_;
+
+    // 窓の中心 (クラスタの重心) が更新領域から窓の半分の大きさ以内にあれば窓が掛かる
+    const double window = std::max((double)FILTER_SQUARE_DIAMETER, ON_MAP_FRONTIER_DETECTION ? std::max(OMF_MAP_WINDOW_X,OMF_MAP_WINDOW_Y) : 0.0);
+    const int reach = 1 + std::ceil(window / 2 / map.info.resolution);
+    std::vector<int> near;
+    cache.overlapping(left-reach, top-reach, right+reach, bottom+reach, near);
+
+    std::vector<int> checks;
+    checks.reserve(near.size() + added.size());
+    for(const auto& id : near){
+        const Eigen::Vector2i& c = cache.clusters[id].index;
+        if(left-reach <= c.x() && c.x() <= right+reach && top-reach <= c.y() && c.y() <= bottom+reach) checks.emplace_back(id);
+    }
+    checks.insert(checks.end(),added.begin(),added.end());
+    std::sort(checks.begin(),checks.end());
+    checks.erase(std::unique(checks.begin(),checks.end()),checks.end());
+    checks.erase(std::remove_if(checks.begin(),checks.end(),[&cache](int id){return !cache.clusters[id].sized;}),checks.end());
+
+    std::vector<char> keep(checks.size(),0);
+    pool_->parallelFor(0, checks.size(), [&](int k){
+        const clusterCacheStruct::cluster& c = cache.clusters[checks[k]];
+        keep[k] = !hasObstacle(map, c.index.x(), c.index.y());
+    });
+    statusMsg_->obstacle_filter = elapsed(start);
+    ROS_INFO_STREAM("Obstacle Filter complete");
+
+    start = ros::WallTime::now();
+    std::vector<exploration_msgs::Frontier> frontiers;
+    std::vector<int> clusterOf;
+    for(int k=0,ke=checks.size();k!=ke;++k){
+        clusterCacheStruct::cluster& c = cache.clusters[checks[k]];
+        if(!keep[k]){
+            if(c.published) cache.lost.emplace_back(c.track);
+            c.published = false;
+            continue;
         }
+        clusterOf.emplace_back(checks[k]);
+        frontiers.emplace_back(ExCos::msgFrontier(ExUtl::mapIndexToCoordinate(c.index.x(),c.index.y(),map.info),c.area,ExCos::msgVector(c.variance.x(),c.variance.y()),c.covariance));
     }
+
+    //onmap
+    if(ON_MAP_FRONTIER_DETECTION) onMapFrontierDetection(map, frontiers);
+    //useful
+    usefulFrontierDetection(frontiers);
+
+    //tracking
+    // 作り直していないクラスタは形が変わらないので id をそのまま使って状態だけを比べる
+    std::vector<int> pending;
+    std::vector<Eigen::Vector2d> centroids;
+    std::vector<Eigen::Vector4d> bounds;
+    std::vector<trackerStruct::track> tracks;
+    tracks.reserve(frontiers.size());
+    for(int f=0,fe=frontiers.size();f!=fe;++f){
+        const clusterCacheStruct::cluster& c = cache.clusters[clusterOf[f]];
+        tracks.push_back({0, 0, trackerStruct::centroidOf(c.index,map.info), trackerStruct::boundsOf(c.bounds,map.info), (int)c.cells.size(), frontiers[f].status});
+        if(c.published){
+            trackerStruct::track& t = tracks.back();
+            t.id = c.track.id;
+            const bool unchanged = trackerStruct::unchanged(c.track,t);
+            t.revision = unchanged ? c.track.revision : c.track.revision + 1;
+            frontiers[f].tracking = unchanged ? exploration_msgs::Frontier::UNCHANGED : exploration_msgs::Frontier::CHANGED;
+            continue;
+        }
+        pending.emplace_back(f);
+        centroids.emplace_back(tracks.back().centroid);
+        bounds.emplace_back(tracks.back().bounds);
+    }
+
+    const std::vector<int> matchOf(trackerStruct::match(cache.lost, centroids, bounds, TRACKING_DISTANCE));
+    std::vector<bool> used(cache.lost.size(),false);
+    for(int k=0,ke=pending.size();k!=ke;++k){
+        const int f = pending[k];
+        trackerStruct::track& t = tracks[f];
+        if(matchOf[k] < 0){
+            t.id = tracker_->nextId++;
+            frontiers[f].tracking = exploration_msgs::Frontier::NEW;
+            continue;
+        }
+        const trackerStruct::track& p = cache.lost[matchOf[k]];
+        used[matchOf[k]] = true;
+        t.id = p.id;
+        const bool unchanged = trackerStruct::unchanged(p,t);
+        t.revision = unchanged ? p.revision : p.revision + 1;
+        frontiers[f].tracking = unchanged ? exploration_msgs::Frontier::UNCHANGED : exploration_msgs::Frontier::CHANGED;
+    }
+    for(int j=0,je=cache.lost.size();j!=je;++j){
+        if(!used[j]) removedIds.emplace_back(cache.lost[j].id);
+    }
+    cache.lost.clear();
+
+    for(int f=0,fe=frontiers.size();f!=fe;++f){
+        clusterCacheStruct::cluster& c = cache.clusters[clusterOf[f]];
+        frontiers[f].id = tracks[f].id;
+        frontiers[f].revision = tracks[f].revision;
+        c.published = true;
+        c.frontier = frontiers[f];
+        c.track = tracks[f];
+    }
+    statusMsg_->classification = elapsed(start);
+}
+
+bool FrontierDetection::hasObstacle(const mapStruct& map, int cx, int cy){
+    // (cx, cy) を中心とした FILTER_SQUARE_DIAMETER の窓の中に障害物があるか
+    ExStc::mapSearchWindow msw(cx,cy,map.info.width,map.info.height,FILTER_SQUARE_DIAMETER/map.info.resolution);
+    if(!map.integral.empty()) return msw.occupiedCount(map.integral) > 0;
+    for(int y=msw.top,ey=msw.bottom+1;y!=ey;++y){
+        for(int x=msw.left,ex=msw.right+1;x!=ex;++x){
+            if(map.source(x,y) == 100) return true;//障害部があったら終了
+        }
+    }
+    return false;
+}
+
+void FrontierDetection::obstacleFilter(FrontierDetection::mapStruct& map,clusterStruct& cs){
+    ROS_INFO_STREAM("Obstacle Filter");
+
+    // クラスタごとに独立しているので並列に判定する
+    pool_->parallelFor(0, cs.index.size(), [&](int i){
+        cs.isObstacle[i] = hasObstacle(map, cs.index[i].x(), cs.index[i].y()) ? 0 : 1;
+    });
     ROS_INFO_STREAM("Obstacle Filter complete");
 }
 
 void FrontierDetection::publishHorizon(const clusterStruct& cs, const std::string& frameId){
-    pcl::PointCloud<pcl::PointXYZRGB>::Ptr colorCloud(new pcl::PointCloud<pcl::PointXYZRGB>);
-    colorCloud->points.reserve(cs.pc->points.size());
-    float colors[12][3] ={{255,0,0},{0,255,0},{0,0,255},{255,255,0},{0,255,255},{255,0,255},{127,255,0},{0,127,255},{127,0,255},{255,127,0},{0,255,127},{255,0,127}};
+    // 表示用なので購読者がいなければ作らない
+    // latch しているので購読者がいない間に新しく購読したノードには次の地図が来るまで古い horizon が届く
+    if(horizon_->pub.getNumSubscribers() == 0) return;
+
+    // 毎回確保し直さないように前回のバッファを使いまわす
+    pcl::PointCloud<pcl::PointXYZRGB>& colorCloud = *horizonCloud_;
+    colorCloud.points.clear();
+    colorCloud.points.reserve(cs.pc->points.size());
     int i=0;
     for (std::vector<pcl::PointIndices>::const_iterator it = cs.indices.begin (); it != cs.indices.end (); ++it,++i){
         // if(cs.index[i].z()==0) continue;
         if(cs.isObstacle[i]==0) continue;
-        int c = i%12;
+        const float* color = HORIZON_COLORS[i%12];
         for (std::vector<int>::const_iterator pit = it->indices.begin (); pit != it->indices.end (); ++pit){
-            colorCloud -> points.emplace_back(ExCos::pclXYZRGB(cs.pc->points[*pit].x,cs.pc->points[*pit].y,0.0f,colors[c][0],colors[c][1],colors[c][2]));
+            colorCloud.points.emplace_back(ExCos::pclXYZRGB(cs.pc->points[*pit].x,cs.pc->points[*pit].y,0.0f,color[0],color[1],color[2]));
+        }
+    }
+    publishHorizonCloud(frameId);
+}
+
+void FrontierDetection::publishHorizon(const mapStruct& map, const clusterCacheStruct& cache, const std::string& frameId){
+    // clusterCache_ の frontier になっているクラスタの horizon を publish する, 色はクラスタの番号で決める
+    if(horizon_->pub.getNumSubscribers() == 0) return;
+
+    pcl::PointCloud<pcl::PointXYZRGB>& colorCloud = *horizonCloud_;
+    colorCloud.points.clear();
+    for(int i=0,ie=cache.clusters.size();i!=ie;++i){
+        const clusterCacheStruct::cluster& c = cache.clusters[i];
+        if(!c.live || !c.published) continue;
+        const float* color = HORIZON_COLORS[i%12];
+        for(const auto& cell : c.cells){
+            const geometry_msgs::Point p = ExUtl::mapIndexToCoordinate(cell.x(),cell.y(),map.info);
+            colorCloud.points.emplace_back(ExCos::pclXYZRGB((float)p.x,(float)p.y,0.0f,color[0],color[1],color[2]));
         }
     }
-    colorCloud -> width = colorCloud -> points.size();
-    colorCloud -> height = 1;
-    colorCloud -> is_dense = true;
+    publishHorizonCloud(frameId);
+}
+
+void FrontierDetection::publishHorizonCloud(const std::string& frameId){
+    pcl::PointCloud<pcl::PointXYZRGB>& colorCloud = *horizonCloud_;
+    colorCloud.width = colorCloud.points.size();
+    colorCloud.height = 1;
+    colorCloud.is_dense = true;
     
-    sensor_msgs::PointCloud2 msg;
-    pcl::toROSMsg(*colorCloud,msg);
+    sensor_msgs::PointCloud2& msg = *horizonMsg_;
+    pcl::toROSMsg(colorCloud,msg);
     msg.header.frame_id = frameId;
     msg.header.stamp = ros::Time::now();
     horizon_->pub.publish(msg);
@@ -259,13 +986,8 @@ void FrontierDetection::onMapFrontierDetection(const FrontierDetection::mapStruc
         // auto faRemove1 = std::remove_if(fa.frontiers.begin(),fa.frontiers.end(),[&,this](exploration_msgs::Frontier& f){
         for(auto&& f : frontiers){
             ExStc::mapSearchWindow msw(f.point,map.info,OMF_MAP_WINDOW_X,OMF_MAP_WINDOW_Y);
-            int c = 0;
-            for(int y=msw.top,ey=msw.bottom+1;y!=ey;++y){
-                for(int x=msw.left,ex=msw.right+1;x!=ex;++x){
-                    if(map.source[x][y] >= 0) ++c;
-                }
-            }
-            if((double)c/(msw.width*msw.height)>ON_MAP_FRONTIER_RATE) f.status = exploration_msgs::Frontier::ON_MAP;
+            int c = map.integral.empty() ? msw.knownCount(map.source) : msw.knownCount(map.integral);
+            if((double)c/msw.area()>ON_MAP_FRONTIER_RATE) f.status = exploration_msgs::Frontier::ON_MAP;
         }
             
             
@@ -289,18 +1011,76 @@ void FrontierDetection::usefulFrontierDetection(std::vector<exploration_msgs::Fr
     }
 }
 
-void FrontierDetection::publishFrontier(const std::vector<exploration_msgs::Frontier>& frontiers, const std::string& frameId){
+void FrontierDetection::frontierTracking(const mapStruct& map, const clusterStruct& cs, const std::vector<int>& clusterOf, std::vector<exploration_msgs::Frontier>& frontiers, std::vector<uint32_t>& removedIds){
+    // 前回の frontier と外接矩形の重なり, 重心の距離で対応を取って id を引き継ぐ
+    // 対応が取れて形が変わっていなければ UNCHANGED, 変わっていれば CHANGED として revision を増やす
+    std::vector<trackerStruct::track>& prev = tracker_->tracks;
+
+    std::vector<Eigen::Vector2d> centroids;
+    std::vector<Eigen::Vector4d> bounds;
+    centroids.reserve(frontiers.size());
+    bounds.reserve(frontiers.size());
+    for(const auto& c : clusterOf){
+        centroids.emplace_back(trackerStruct::centroidOf(cs.index[c],map.info));
+        bounds.emplace_back(trackerStruct::boundsOf(cs.bounds[c],map.info));
+    }
+
+    const std::vector<int> matchOf(trackerStruct::match(prev, centroids, bounds, TRACKING_DISTANCE));
+    std::vector<bool> used(prev.size(),false);
+    for(const auto& m : matchOf){
+        if(m >= 0) used[m] = true;
+    }
+
+    std::vector<trackerStruct::track> tracks;
+    tracks.reserve(frontiers.size());
+    for(int i=0,ie=frontiers.size();i!=ie;++i){
+        const int c = clusterOf[i];
+        trackerStruct::track t{0, 0, centroids[i], bounds[i], (int)cs.indices[c].indices.size(), frontiers[i].status};
+        if(matchOf[i] < 0){
+            t.id = tracker_->nextId++;
+            frontiers[i].tracking = exploration_msgs::Frontier::NEW;
+        }
+        else{
+            const trackerStruct::track& p = prev[matchOf[i]];
+            t.id = p.id;
+            const bool unchanged = trackerStruct::unchanged(p,t);
+            t.revision = unchanged ? p.revision : p.revision + 1;
+            frontiers[i].tracking = unchanged ? exploration_msgs::Frontier::UNCHANGED : exploration_msgs::Frontier::CHANGED;
+        }
+        frontiers[i].id = t.id;
+        frontiers[i].revision = t.revision;
+        tracks.emplace_back(std::move(t));
+    }
+
+    for(int j=0,je=prev.size();j!=je;++j){
+        if(!used[j]) removedIds.emplace_back(prev[j].id);
+    }
+    prev.swap(tracks);
+}
+
+void FrontierDetection::publishFrontier(const std::vector<exploration_msgs::Frontier>& frontiers, const std::vector<uint32_t>& removedIds, const std::string& frameId){
     exploration_msgs::FrontierArray msg;
     msg.frontiers = frontiers;
+    msg.removed_ids = removedIds;
     msg.header.frame_id = frameId;
     msg.header.stamp = ros::Time::now();
     frontier_->pub.publish(msg);
     ROS_INFO_STREAM("Publish frontier");
 }
 
+void FrontierDetection::publishStatus(void){
+    // 地図のタイムスタンプから frontier を publish し終わるまでの遅れと各段階の処理時間
+    statusMsg_->header.stamp = ros::Time::now();
+    statusMsg_->latency = (statusMsg_->header.stamp - statusMsg_->map_stamp).toSec();
+    statusMsg_->total = statusMsg_->map_conversion + statusMsg_->horizon_detection + statusMsg_->clustering + statusMsg_->obstacle_filter + statusMsg_->classification + statusMsg_->publish;
+    status_->pub.publish(*statusMsg_);
+}
+
 void FrontierDetection::loadParams(void){
     ros::NodeHandle nh("~/frontier");
     // dynamic parameters
+    nh.param<int>("worker_threads", WORKER_THREADS, 1);
+    nh.param<bool>("grid_clustering", GRID_CLUSTERING, true);
     nh.param<double>("cluster_tolerance", CLUSTER_TOLERANCE, 0.15);
     nh.param<int>("min_cluster_size", MIN_CLUSTER_SIZE, 30);
     nh.param<int>("max_cluster_size", MAX_CLUSTER_SIZE, 15000);
@@ -312,13 +1092,26 @@ void FrontierDetection::loadParams(void){
     nh.param<double>("variance_threshold", VARIANCE_THRESHOLD, 1.5);
     nh.param<double>("variance_min_threshold", VARIANCE_MIN_THRESHOLD, 0.1);
     nh.param<double>("covariance_threshold", COVARIANCE_THRESHOLD, 0.7);
+    nh.param<double>("tracking_distance", TRACKING_DISTANCE, 0.5);
+    nh.param<bool>("wavefront_detection", WAVEFRONT_DETECTION, false);
+    nh.param<double>("wavefront_seed_radius", WAVEFRONT_SEED_RADIUS, 0.5);
    
     // static parameters
     nh.param<std::string>("frontier_parameter_file_path",FRONTIER_PARAMETER_FILE_PATH,"frontier_last_parameters.yaml");
     nh.param<bool>("output_frontier_parameters",OUTPUT_FRONTIER_PARAMETERS,true);
+    nh.param<bool>("use_map_updates",USE_MAP_UPDATES,false);
 }
 
 void FrontierDetection::dynamicParamsCB(exploration_support::frontier_detection_parameter_reconfigureConfig &cfg, uint32_t level){
+    // クラスタのパラメータが変わったら保持しているクラスタは使えない
+    // 障害物, 地図ができているか, 有用かの判定のパラメータが変わったら保持している frontier の判定も使えない
+    // wavefront との切り替えでは保持している horizon も作り直す
+    const bool clusterChanged = WAVEFRONT_DETECTION != cfg.wavefront_detection || GRID_CLUSTERING != cfg.grid_clustering || CLUSTER_TOLERANCE != cfg.cluster_tolerance || MIN_CLUSTER_SIZE != cfg.min_cluster_size || MAX_CLUSTER_SIZE != cfg.max_cluster_size;
+    const bool filterChanged = FILTER_SQUARE_DIAMETER != cfg.filter_square_diameter || ON_MAP_FRONTIER_DETECTION != cfg.on_map_frontier_detection || OMF_MAP_WINDOW_X != cfg.omf_map_window_x || OMF_MAP_WINDOW_Y != cfg.omf_map_window_y || ON_MAP_FRONTIER_RATE != cfg.on_map_frontier_rate || VARIANCE_THRESHOLD != cfg.variance_threshold || VARIANCE_MIN_THRESHOLD != cfg.variance_min_threshold || COVARIANCE_THRESHOLD != cfg.covariance_threshold;
+    if(clusterChanged || filterChanged) clusterCache_.reset();
+    if(WORKER_THREADS != cfg.worker_threads) pool_.reset(new ExpLib::ThreadPool(cfg.worker_threads));
+    WORKER_THREADS = cfg.worker_threads;
+    GRID_CLUSTERING = cfg.grid_clustering;
     CLUSTER_TOLERANCE = cfg.cluster_tolerance;
     MIN_CLUSTER_SIZE = cfg.min_cluster_size;
     MAX_CLUSTER_SIZE = cfg.max_cluster_size;
@@ -330,6 +1123,9 @@ void FrontierDetection::dynamicParamsCB(exploration_support::frontier_detection_
     VARIANCE_THRESHOLD = cfg.variance_threshold;
     VARIANCE_MIN_THRESHOLD = cfg.variance_min_threshold;
     COVARIANCE_THRESHOLD = cfg.covariance_threshold;
+    TRACKING_DISTANCE = cfg.tracking_distance;
+    WAVEFRONT_DETECTION = cfg.wavefront_detection;
+    WAVEFRONT_SEED_RADIUS = cfg.wavefront_seed_radius;
 }
 
 void FrontierDetection::outputParams(void){
@@ -342,6 +1138,8 @@ void FrontierDetection::outputParams(void){
         return;
     }
 
+    ofs << "worker_threads: " << WORKER_THREADS << std::endl;
+    ofs << "grid_clustering: " << (GRID_CLUSTERING ? "true" : "false") << std::endl;
     ofs << "cluster_tolerance: " << CLUSTER_TOLERANCE << std::endl;
     ofs << "min_cluster_size: " << MIN_CLUSTER_SIZE << std::endl;
     ofs << "max_cluster_size: " << MAX_CLUSTER_SIZE << std::endl;   
@@ -353,4 +1151,7 @@ void FrontierDetection::outputParams(void){
     ofs << "variance_threshold: " << VARIANCE_THRESHOLD << std::endl;
     ofs << "variance_min_threshold: " << VARIANCE_MIN_THRESHOLD << std::endl;
     ofs << "covariance_threshold: " << COVARIANCE_THRESHOLD << std::endl;
+    ofs << "tracking_distance: " << TRACKING_DISTANCE << std::endl;
+    ofs << "wavefront_detection: " << (WAVEFRONT_DETECTION ? "true" : "false") << std::endl;
+    ofs << "wavefront_seed_radius: " << WAVEFRONT_SEED_RADIUS << std::endl;
  }
\ No newline at end of file
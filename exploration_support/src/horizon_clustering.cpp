@@ -0,0 +1,187 @@
+#include <exploration_support/horizon_clustering.h>
+#include <exploration_support/horizon_kernel.h>
+#include <exploration_libraly/thread_pool.h>
+#include <nav_msgs/MapMetaData.h>
+#include <pcl/segmentation/extract_clusters.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <numeric>
+
+namespace HorizonClustering{
+    moment::moment():count(0),sx(0),sy(0),sxx(0),syy(0),sxy(0),bounds(INT_MAX,INT_MAX,INT_MIN,INT_MIN){}
+
+    void moment::add(int x, int y){
+        ++count;
+        sx += x;
+        sy += y;
+        sxx += int64_t(x)*x;
+        syy += int64_t(y)*y;
+        sxy += int64_t(x)*y;
+        bounds << std::min(bounds[0],x), std::min(bounds[1],y), std::max(bounds[2],x), std::max(bounds[3],y);
+    }
+
+    Eigen::Vector2d moment::centroid(const nav_msgs::MapMetaData& info) const {
+        return Eigen::Vector2d(info.origin.position.x + info.resolution * sx / count, info.origin.position.y + info.resolution * sy / count);
+    }
+
+    Eigen::Vector2d moment::variance(double resolution) const {
+        const double n = count;
+        return Eigen::Vector2d(resolution * resolution * (n * sxx - sx * sx) / (n * n), resolution * resolution * (n * syy - sy * sy) / (n * n));
+    }
+
+    double moment::covariance(double resolution) const {
+        const double n = count;
+        const Eigen::Vector2d v(variance(resolution));
+        return resolution * resolution * (n * sxy - sx * sy) / (n * n) / sqrt(v.x()) / sqrt(v.y());
+    }
+
+    double moment::area(double resolution) const {
+        return std::abs((bounds[2] - bounds[0]) * resolution * (bounds[3] - bounds[1]) * resolution);
+    }
+
+    void grid(const std::vector<Eigen::Vector2i>& cells, const nav_msgs::MapMetaData& info, double tolerance, int minSize, int maxSize, ExpLib::ThreadPool& pool, std::vector<pcl::PointIndices>& indices, std::vector<moment>& moments){
+        // horizon は格子上にあるので KdTree を使わずにセル単位の union-find でクラスタリングする
+        // 許容距離以内のセル同士を同じクラスタとみなす (EuclideanClusterExtraction と同じ判定)
+        indices.clear();
+        moments.clear();
+        if(cells.empty()) return;
+
+        const double r = tolerance / info.resolution + 1e-9; // 割り算の丸め誤差で半径が1セル小さくならないように
+        const int rc = r;
+        const int rr = r * r;
+
+        // 注目セルより後ろ(y が大きい, または y が同じで x が大きい)の近傍だけを見れば全ての組を一度ずつ調べられる
+        std::vector<Eigen::Vector2i> offsets;
+        for(int dy=0;dy<=rc;++dy){
+            for(int dx=-rc;dx<=rc;++dx){
+                if((dy == 0 && dx <= 0) || dx*dx + dy*dy > rr) continue;
+                offsets.emplace_back(dx,dy);
+            }
+        }
+
+        // 外接矩形上のビット列と, 各要素より前に立っているビットの数からセル -> 点番号を引く
+        const int minY = cells.front().y();
+        int minX = cells.front().x(), maxX = cells.front().x();
+        for(const auto& c : cells){
+            minX = std::min(minX, c.x());
+            maxX = std::max(maxX, c.x());
+        }
+        const int w = maxX - minX + 1;
+        const int h = cells.back().y() - minY + 1;
+        const int words = HorizonKernel::wordsPerRow(w);
+        std::vector<uint64_t> bits(words*h,0);
+        for(const auto& c : cells) bits[(c.y()-minY)*words + ((c.x()-minX)>>6)] |= uint64_t(1) << ((c.x()-minX)&63);
+        std::vector<int> rank(words*h+1,0);
+        for(int k=0,ke=words*h;k!=ke;++k) rank[k+1] = rank[k] + __builtin_popcountll(bits[k]);
+        auto lookup = [&](int x, int y){
+            const int k = y*words + (x>>6);
+            const uint64_t mask = uint64_t(1) << (x&63);
+            return bits[k] & mask ? rank[k] + __builtin_popcountll(bits[k] & (mask-1)) : -1;
+        };
+
+        std::vector<int> parent(cells.size());
+        std::iota(parent.begin(),parent.end(),0);
+        auto find = [&parent](int i){
+            while(parent[i] != i) i = parent[i] = parent[parent[i]];
+            return i;
+        };
+        auto unite = [&find,&parent](int i, int j){
+            const int a = find(i), b = find(j);
+            if(a != b) parent[std::max(a,b)] = std::min(a,b);
+        };
+
+        // 地図を行方向の帯に分けて帯の中だけを並列に union-find する
+        // 帯の中のセルは点番号が連続しているので, 別々の帯が parent の同じ要素を触ることはない
+        const int bh = HorizonKernel::bandHeight(h, pool.size());
+        const int bands = (h + bh - 1) / bh;
+        pool.parallelFor(0, bands, [&](int t){
+            const int top = t*bh;
+            const int bottom = std::min(h, top + bh);
+            for(int i=rank[top*words],ie=rank[bottom*words];i!=ie;++i){
+                const int x = cells[i].x() - minX;
+                const int y = cells[i].y() - minY;
+                for(const auto& o : offsets){
+                    const int nx = x + o.x();
+                    const int ny = y + o.y();
+                    if(nx < 0 || nx >= w || ny >= bottom) continue;
+                    const int j = lookup(nx,ny);
+                    if(j >= 0) unite(i,j);
+                }
+            }
+        });
+
+        // 帯の境目をまたぐ組をつなぐ, 境目から rc 行以内のセルだけを見れば良い
+        for(int t=1;t<bands;++t){
+            const int seam = t*bh;
+            for(int i=rank[std::max(0,seam-rc)*words],ie=rank[seam*words];i!=ie;++i){
+                const int x = cells[i].x() - minX;
+                const int y = cells[i].y() - minY;
+                for(const auto& o : offsets){
+                    const int nx = x + o.x();
+                    const int ny = y + o.y();
+                    if(nx < 0 || nx >= w || ny < seam || ny >= h) continue;
+                    const int j = lookup(nx,ny);
+                    if(j >= 0) unite(i,j);
+                }
+            }
+        }
+
+        // 根ごとにモーメントを積算する
+        std::vector<int> label(cells.size(), -1);
+        std::vector<moment> all;
+        for(int i=0,ie=cells.size();i!=ie;++i){
+            const int root = find(i);
+            if(label[root] < 0){
+                label[root] = all.size();
+                all.emplace_back();
+            }
+            all[label[root]].add(cells[i].x(),cells[i].y());
+            label[i] = label[root];
+        }
+
+        // EuclideanClusterExtraction と同じく大きいクラスタから並べる
+        std::vector<int> order;
+        order.reserve(all.size());
+        for(int l=0,le=all.size();l!=le;++l){
+            if(minSize <= all[l].count && all[l].count <= maxSize) order.emplace_back(l);
+        }
+        std::stable_sort(order.begin(),order.end(),[&all](int a, int b){return all[a].count > all[b].count;});
+
+        std::vector<int> clusterOf(all.size(), -1);
+        indices.resize(order.size());
+        moments.reserve(order.size());
+        for(int k=0,ke=order.size();k!=ke;++k){
+            clusterOf[order[k]] = k;
+            indices[k].indices.reserve(all[order[k]].count);
+            moments.emplace_back(all[order[k]]);
+        }
+        for(int i=0,ie=cells.size();i!=ie;++i){
+            if(clusterOf[label[i]] >= 0) indices[clusterOf[label[i]]].indices.emplace_back(i);
+        }
+    }
+
+    void euclidean(const std::vector<Eigen::Vector2i>& cells, const pcl::PointCloud<pcl::PointXYZ>::Ptr& pc, double tolerance, int minSize, int maxSize, std::vector<pcl::PointIndices>& indices, std::vector<moment>& moments){
+        indices.clear();
+        moments.clear();
+        if(pc -> points.empty()) return;
+
+        pcl::search::KdTree<pcl::PointXYZ>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZ>);
+        tree->setInputCloud (pc);
+
+        pcl::EuclideanClusterExtraction<pcl::PointXYZ> ec;
+        ec.setClusterTolerance (tolerance);//同じクラスタとみなす距離
+        ec.setMinClusterSize (minSize);//クラスタを構成する最小の点数
+        ec.setMaxClusterSize (maxSize);//クラスタを構成する最大の点数
+        ec.setSearchMethod (tree);
+        ec.setInputCloud (pc);
+
+        ec.extract (indices);
+
+        // 統計値は格子と同じくセル番号から求める
+        moments.resize(indices.size());
+        for(int k=0,ke=indices.size();k!=ke;++k){
+            for(const auto& i : indices[k].indices) moments[k].add(cells[i].x(),cells[i].y());
+        }
+    }
+}
@@ -0,0 +1,134 @@
+#include <exploration_support/horizon_kernel.h>
+#include <algorithm>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HORIZON_KERNEL_X86
+#endif
+
+namespace{
+    // 行の端は未知領域ではないものとして扱う
+    // up, down は上下の行, 地図の外なら全て 0 の行を渡す
+    inline bool horizonCell(const int8_t* up, const int8_t* row, const int8_t* down, int width, int x){
+        return HorizonKernel::isFree(row[x]) && ((x > 0 && row[x-1] == -1) || (x < width-1 && row[x+1] == -1) || up[x] == -1 || down[x] == -1);
+    };
+
+    inline void setBits(uint64_t* bits, int x, uint64_t mask, int n){
+        // bits の x ビット目から n ビットを mask で上書きせずに立てる (bits は事前に0で初期化済み)
+        const int w = x >> 6;
+        const int o = x & 63;
+        bits[w] |= mask << o;
+        if(o + n > 64) bits[w+1] |= mask >> (64 - o);
+    };
+
+    void scalarRow(const int8_t* up, const int8_t* row, const int8_t* down, int width, int begin, int end, uint64_t* bits){
+        for(int x=begin;x<end;++x){
+            if(horizonCell(up,row,down,width,x)) bits[x>>6] |= uint64_t(1) << (x&63);
+        }
+    };
+
+#ifdef HORIZON_KERNEL_X86
+    __attribute__((target("sse2"))) int sse2Row(const int8_t* up, const int8_t* row, const int8_t* down, int width, uint64_t* bits){
+        // x=0 と x=width-1 は左右の隣が無いので 1 から width-17 までを 16 セルずつ処理する
+        const __m128i unknown = _mm_set1_epi8(-1);
+        const __m128i occupied = _mm_set1_epi8(99);
+        int x = 1;
+        for(;x+17<=width;x+=16){
+            const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row+x));
+            const __m128i free = _mm_and_si128(_mm_cmpgt_epi8(c,unknown),_mm_cmplt_epi8(c,occupied));
+            const __m128i adj = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row+x-1)),unknown),_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row+x+1)),unknown)),
+                _mm_or_si128(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(up+x)),unknown),_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(down+x)),unknown)));
+            const uint64_t m = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(free,adj)));
+            if(m) setBits(bits,x,m,16);
+        }
+        return x;
+    };
+
+    __attribute__((target("avx2"))) int avx2Row(const int8_t* up, const int8_t* row, const int8_t* down, int width, uint64_t* bits){
+        // 32 セルずつ処理する
+        const __m256i unknown = _mm256_set1_epi8(-1);
+        const __m256i occupied = _mm256_set1_epi8(98); // AVX2 には cmplt が無いので v > 98 の否定で v < 99 を求める
+        int x = 1;
+        for(;x+33<=width;x+=32){
+            const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row+x));
+            const __m256i free = _mm256_andnot_si256(_mm256_cmpgt_epi8(c,occupied),_mm256_cmpgt_epi8(c,unknown));
+            const __m256i adj = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row+x-1)),unknown),_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row+x+1)),unknown)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(up+x)),unknown),_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(down+x)),unknown)));
+            const uint64_t m = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(free,adj)));
+            if(m) setBits(bits,x,m,32);
+        }
+        return x;
+    };
+#endif
+}
+
+namespace HorizonKernel{
+    Isa bestIsa(void){
+#ifdef HORIZON_KERNEL_X86
+        static const Isa isa = __builtin_cpu_supports("avx2") ? Isa::AVX2 : __builtin_cpu_supports("sse2") ? Isa::SSE2 : Isa::SCALAR;
+        return isa;
+#else
+        return Isa::SCALAR;
+#endif
+    }
+
+    const char* isaName(Isa isa){
+        switch(isa){
+            case Isa::AVX2: return "AVX2";
+            case Isa::SSE2: return "SSE2";
+            default: return "SCALAR";
+        }
+    }
+
+    void horizon(const int8_t* data, int width, int height, uint64_t* bitmap, Isa isa){
+        horizonRows(data,width,height,0,height,bitmap,isa);
+    }
+
+    void horizonRows(const int8_t* data, int width, int height, int top, int bottom, uint64_t* bitmap, Isa isa){
+        const int words = wordsPerRow(width);
+        std::fill(bitmap+top*words,bitmap+bottom*words,0);
+        if(width <= 0 || top >= bottom) return;
+
+        const std::vector<int8_t> outside(width,0);
+        for(int y=top;y<bottom;++y){
+            const int8_t* row = data + y*width;
+            const int8_t* up = y > 0 ? row - width : outside.data();
+            const int8_t* down = y < height-1 ? row + width : outside.data();
+            uint64_t* bits = bitmap + y*words;
+
+            int x = 0;
+#ifdef HORIZON_KERNEL_X86
+            if(isa == Isa::AVX2) x = avx2Row(up,row,down,width,bits);
+            else if(isa == Isa::SSE2) x = sse2Row(up,row,down,width,bits);
+#endif
+            // 左端と SIMD で処理しきれなかった右側
+            if(x > 0) scalarRow(up,row,down,width,0,1,bits);
+            scalarRow(up,row,down,width,x,width,bits);
+        }
+    }
+
+    void horizon(const int8_t* data, int width, int height, uint64_t* bitmap){
+        horizon(data,width,height,bitmap,bestIsa());
+    }
+
+    void horizonRow(const int8_t* data, int width, int height, int y, int left, int right, uint64_t* bitmap){
+        const int words = wordsPerRow(width);
+        const std::vector<int8_t> outside(y > 0 && y < height-1 ? 0 : width,0);
+        const int8_t* row = data + y*width;
+        const int8_t* up = y > 0 ? row - width : outside.data();
+        const int8_t* down = y < height-1 ? row + width : outside.data();
+        uint64_t* bits = bitmap + y*words;
+        for(int x=left;x<=right;++x){
+            const uint64_t b = uint64_t(1) << (x&63);
+            if(horizonCell(up,row,down,width,x)) bits[x>>6] |= b;
+            else bits[x>>6] &= ~b;
+        }
+    }
+
+    bool isHorizon(const int8_t* data, int width, int height, int x, int y){
+        const int8_t* row = data + y*width;
+        return isFree(row[x]) && ((x > 0 && row[x-1] == -1) || (x < width-1 && row[x+1] == -1) || (y > 0 && row[x-width] == -1) || (y < height-1 && row[x+width] == -1));
+    }
+}
@@ -0,0 +1,97 @@
+#include <exploration_support/horizon_kernel.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// HorizonKernel と以前の horizonDetection (二次元配列に転置して x,y 軸を走査する実装) の速度比較
+// 使い方 : rosrun exploration_support horizon_kernel_benchmark [繰り返し回数]
+
+namespace{
+    std::vector<int8_t> makeMap(int size){
+        // 中心から広がる既知領域の中に障害物を散らした地図
+        std::vector<int8_t> data(size*size,-1);
+        std::mt19937 gen(size);
+        std::uniform_real_distribution<double> noise(-0.1,0.1);
+        std::uniform_int_distribution<int> cell(0,99);
+        const double c = size / 2.0;
+        for(int y=0;y<size;++y){
+            for(int x=0;x<size;++x){
+                double r = std::hypot(x-c,y-c) / c;
+                double a = std::atan2(y-c,x-c);
+                if(r < 0.6 + 0.2*std::sin(7*a) + noise(gen)) data[y*size+x] = cell(gen) < 3 ? 100 : 0;
+            }
+        }
+        return data;
+    }
+
+    std::vector<std::vector<int8_t>> legacyHorizon(const std::vector<int8_t>& data, int width, int height){
+        // mapArray1dTo2d
+        std::vector<std::vector<int8_t>> source(width,std::vector<int8_t>(height));
+        for(int y=0,k=0;y!=height;++y){
+            for(int x=0;x!=width;++x,++k) source[x][y] = data[k];
+        }
+        std::vector<std::vector<int8_t>> horizon(width,std::vector<int8_t>(height,0));
+
+        auto isHorizon = [](int8_t free, int8_t unknown){
+            return (0 <= free && free < 99) && unknown == -1;
+        };
+        for(int y=0;y!=height;++y){
+            for(int x=0,ex=width-1;x!=ex;++x){
+                if(isHorizon(source[x][y], source[x+1][y])) horizon[x][y] = 1;
+                else if(isHorizon(source[x+1][y], source[x][y])) horizon[x+1][y] = 1;
+            }
+        }
+        for(int x=0;x!=width;++x){
+            for(int y=0,ey=height-1;y!=ey;++y){
+                if(isHorizon(source[x][y], source[x][y+1])) horizon[x][y] = 1;
+                else if(isHorizon(source[x][y+1], source[x][y])) horizon[x][y+1] = 1;
+            }
+        }
+        return horizon;
+    }
+
+    template <typename F>
+    double measure(int repeat, F f){
+        // 一回目はキャッシュを温めるため計測しない
+        f();
+        auto start = std::chrono::steady_clock::now();
+        for(int i=0;i<repeat;++i) f();
+        return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - start).count() / repeat;
+    }
+}
+
+int main(int argc, char* argv[]){
+    const int repeat = argc > 1 ? std::max(1,std::atoi(argv[1])) : 5;
+    std::vector<HorizonKernel::Isa> isas{HorizonKernel::Isa::SCALAR};
+    if(HorizonKernel::bestIsa() != HorizonKernel::Isa::SCALAR) isas.emplace_back(HorizonKernel::Isa::SSE2);
+    if(HorizonKernel::bestIsa() == HorizonKernel::Isa::AVX2) isas.emplace_back(HorizonKernel::Isa::AVX2);
+
+    std::cout << "best isa : " << HorizonKernel::isaName(HorizonKernel::bestIsa()) << ", repeat : " << repeat << std::endl;
+
+    for(int size : {1024, 4096, 8192}){
+        const std::vector<int8_t> data(makeMap(size));
+        std::vector<uint64_t> bitmap(size*HorizonKernel::wordsPerRow(size));
+        const int words = HorizonKernel::wordsPerRow(size);
+
+        std::vector<std::vector<int8_t>> legacy;
+        double legacyTime = measure(repeat,[&]{legacy = legacyHorizon(data,size,size);});
+        std::cout << size << "x" << size << " legacy : " << legacyTime << " ms" << std::endl;
+
+        for(const auto& isa : isas){
+            double t = measure(repeat,[&]{HorizonKernel::horizon(data.data(),size,size,bitmap.data(),isa);});
+            // 結果が以前の実装と一致するか確認する
+            int mismatch = 0;
+            for(int y=0;y<size;++y){
+                for(int x=0;x<size;++x){
+                    if(HorizonKernel::test(bitmap.data(),words,x,y) != (legacy[x][y] == 1)) ++mismatch;
+                }
+            }
+            std::cout << size << "x" << size << " " << HorizonKernel::isaName(isa) << " : " << t << " ms (x" << legacyTime / t << ")" << (mismatch == 0 ? "" : " MISMATCH : " + std::to_string(mismatch)) << std::endl;
+        }
+    }
+    return 0;
+}
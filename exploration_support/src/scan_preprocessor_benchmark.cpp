@@ -0,0 +1,133 @@
+#include <exploration_libraly/scan_preprocessor.h>
+#include <exploration_libraly/struct.h>
+#include <sensor_msgs/LaserScan.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+// ScanPreprocessor と以前の各ノードのループ (ビームごとに角度と sin, cos を求める実装) の速度比較
+// 使い方 : rosrun exploration_support scan_preprocessor_benchmark [繰り返し回数]
+
+namespace ExStc = ExpLib::Struct;
+
+namespace{
+    sensor_msgs::LaserScan makeScan(int beams){
+        // 前方 270 度, 1 割ほどのビームが nan のスキャン
+        sensor_msgs::LaserScan scan;
+        scan.angle_min = -3 * M_PI / 4;
+        scan.angle_max = 3 * M_PI / 4;
+        scan.angle_increment = (scan.angle_max - scan.angle_min) / (beams - 1);
+        scan.range_min = 0.1;
+        scan.range_max = 10.0;
+        scan.ranges.resize(beams);
+        std::mt19937 gen(beams);
+        std::uniform_real_distribution<float> range(0.2,8.0);
+        std::uniform_int_distribution<int> cell(0,9);
+        for(auto&& r : scan.ranges) r = cell(gen) == 0 ? std::numeric_limits<float>::quiet_NaN() : range(gen);
+        return scan;
+    }
+
+    // branch_detection の scanCB
+    void legacyScanStruct(const sensor_msgs::LaserScan& scan, ExStc::scanStruct& ss){
+        ss.ranges.clear();
+        ss.angles.clear();
+        ss.x.clear();
+        ss.y.clear();
+        for(int i=0,e=scan.ranges.size();i!=e;++i){
+            if(!std::isnan(scan.ranges[i])){
+                float temp = scan.angle_min+(scan.angle_increment*i);
+                ss.ranges.emplace_back(scan.ranges[i]);
+                ss.x.emplace_back(scan.ranges[i]*cos(temp));
+                ss.y.emplace_back(scan.ranges[i]*sin(temp));
+                ss.angles.emplace_back(std::move(temp));
+            }
+        }
+    }
+
+    // movement の roadCenterDetection
+    void legacyRoadScanStruct(const sensor_msgs::LaserScan& scan, ExStc::scanStruct& ss, double threshold){
+        ss.ranges.clear();
+        ss.angles.clear();
+        ss.x.clear();
+        ss.y.clear();
+        for(int i=0,e=scan.ranges.size();i!=e;++i){
+            if(!std::isnan(scan.ranges[i])){
+                double tempAngle = scan.angle_min+(scan.angle_increment*i);
+                if(scan.ranges[i]*cos(tempAngle) <= threshold){
+                    ss.ranges.emplace_back(scan.ranges[i]);
+                    ss.x.emplace_back(scan.ranges[i]*cos(tempAngle));
+                    ss.y.emplace_back(scan.ranges[i]*sin(tempAngle));
+                    ss.angles.emplace_back(std::move(tempAngle));
+                }
+            }
+        }
+    }
+
+    // movement の前方の距離
+    void legacyForwardRanges(const sensor_msgs::LaserScan& scan, std::vector<float>& scanCalced){
+        scanCalced.clear();
+        scanCalced.reserve(scan.ranges.size());
+        for(int i=0,e=scan.ranges.size();i!=e;++i)
+            scanCalced.emplace_back(!std::isnan(scan.ranges[i]) ? scan.ranges[i]*cos(scan.angle_min+(scan.angle_increment*i)) : scan.ranges[i]);
+    }
+
+    int mismatch(const std::vector<float>& l, const std::vector<float>& r){
+        // 以前は double で計算していた所もあるので表の float との差は許す
+        if(l.size() != r.size()) return std::max(l.size(),r.size());
+        int c = 0;
+        for(int i=0,ie=l.size();i!=ie;++i){
+            if(std::isnan(l[i]) != std::isnan(r[i]) || (!std::isnan(l[i]) && std::abs(l[i] - r[i]) > 1e-4)) ++c;
+        }
+        return c;
+    }
+
+    int mismatch(const ExStc::scanStruct& l, const ExStc::scanStruct& r){
+        return mismatch(l.ranges,r.ranges) + mismatch(l.angles,r.angles) + mismatch(l.x,r.x) + mismatch(l.y,r.y);
+    }
+
+    template <typename F>
+    double measure(int repeat, F f){
+        // 一回目は表の作成とキャッシュを温めるため計測しない
+        f();
+        auto start = std::chrono::steady_clock::now();
+        for(int i=0;i<repeat;++i) f();
+        return std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now() - start).count() / repeat;
+    }
+
+    void report(const std::string& name, int beams, double legacyTime, double t, int diff){
+        std::cout << beams << " beams " << name << " : legacy " << legacyTime << " us, preprocessor " << t << " us (x" << legacyTime / t << ")" << (diff == 0 ? "" : " MISMATCH : " + std::to_string(diff)) << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]){
+    const int repeat = argc > 1 ? std::max(1,std::atoi(argv[1])) : 10000;
+    const double ROAD_CENTER_THRESHOLD = 5.0;
+
+    std::cout << "repeat : " << repeat << std::endl;
+
+    for(int beams : {360, 720, 1440}){
+        const sensor_msgs::LaserScan scan(makeScan(beams));
+        ExpLib::ScanPreprocessor sp;
+        ExStc::scanStruct legacy(beams), ss(beams);
+        std::vector<float> legacyForward, forward;
+
+        double legacyTime = measure(repeat,[&]{legacyScanStruct(scan,legacy);});
+        double t = measure(repeat,[&]{sp.toScanStruct(scan,ss);});
+        report("scanStruct", beams, legacyTime, t, mismatch(legacy,ss));
+
+        legacyTime = measure(repeat,[&]{legacyRoadScanStruct(scan,legacy,ROAD_CENTER_THRESHOLD);});
+        t = measure(repeat,[&]{sp.toScanStruct(scan,ss,ROAD_CENTER_THRESHOLD);});
+        report("road scanStruct", beams, legacyTime, t, mismatch(legacy,ss));
+
+        legacyTime = measure(repeat,[&]{legacyForwardRanges(scan,legacyForward);});
+        t = measure(repeat,[&]{sp.forwardRanges(scan,forward);});
+        report("forward ranges", beams, legacyTime, t, mismatch(legacyForward,forward));
+    }
+    return 0;
+}
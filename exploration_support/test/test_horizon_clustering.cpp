@@ -0,0 +1,196 @@
+#include <exploration_support/horizon_clustering.h>
+#include <exploration_support/horizon_kernel.h>
+#include <exploration_libraly/thread_pool.h>
+#include <gtest/gtest.h>
+#include <nav_msgs/MapMetaData.h>
+#include <algorithm>
+#include <climits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace{
+    // '.' : 自由領域, '#' : 障害物, '?' : 未知領域
+    const std::vector<std::string> ROOMS = {
+        "????????????????????????????????????????",
+        "?######################?????????????????",
+        "?#..........#.........#?????????????????",
+        "?#..........#.........#????......???????",
+        "?#..........#..........?????.......?????",
+        "?#...........................#.....?????",
+        "?#..........#.........#??????#....??????",
+        "?#####.######.........#??????#...???????",
+        "?????#.#????#.........#??????###????????",
+        "?????#.#????###########?????????????????",
+        "?????#..????????????????????????????????",
+        "?????#..??????.??????????...????????????",
+        "?????#########?????????????.????????????",
+        "???????????????????????????.????????????",
+        "????????????????????????????????????????",
+    };
+
+    struct grid{
+        nav_msgs::MapMetaData info;
+        std::vector<int8_t> data;
+    };
+
+    nav_msgs::MapMetaData mapInfo(int width, int height){
+        nav_msgs::MapMetaData info;
+        info.width = width;
+        info.height = height;
+        info.resolution = 0.05;
+        info.origin.position.x = -10.0;
+        info.origin.position.y = -10.0;
+        info.origin.orientation.w = 1.0;
+        return info;
+    }
+
+    grid fromText(const std::vector<std::string>& text){
+        grid g;
+        g.info = mapInfo(text.front().size(),text.size());
+        for(const auto& row : text){
+            for(const auto& c : row) g.data.emplace_back(c == '.' ? 0 : c == '#' ? 100 : -1);
+        }
+        return g;
+    }
+
+    // 未知領域の中に自由領域の四角と障害物の点を散らした地図
+    grid randomGrid(int width, int height, unsigned seed){
+        grid g;
+        g.info = mapInfo(width,height);
+        g.data.assign(width*height,-1);
+        std::mt19937 gen(seed);
+        std::uniform_int_distribution<int> x(0,width-1), y(0,height-1), size(2,12), percent(0,99);
+        for(int k=0;k<width*height/60;++k){
+            const int l = x(gen), t = y(gen), r = std::min(width-1,l+size(gen)), b = std::min(height-1,t+size(gen));
+            for(int j=t;j<=b;++j){
+                for(int i=l;i<=r;++i) g.data[j*width+i] = percent(gen) < 5 ? 100 : 0;
+            }
+        }
+        return g;
+    }
+
+    // frontier_detection と同じく horizon を y, x の順に取り出す
+    std::vector<Eigen::Vector2i> horizonCells(const grid& g){
+        const int width = g.info.width, height = g.info.height;
+        const int words = HorizonKernel::wordsPerRow(width);
+        std::vector<uint64_t> bitmap(words*height,0);
+        HorizonKernel::horizon(g.data.data(),width,height,bitmap.data());
+        std::vector<Eigen::Vector2i> cells;
+        for(int y=0;y<height;++y){
+            for(int x=0;x<width;++x){
+                if(HorizonKernel::test(bitmap.data(),words,x,y)) cells.emplace_back(x,y);
+            }
+        }
+        return cells;
+    }
+
+    pcl::PointCloud<pcl::PointXYZ>::Ptr toCloud(const std::vector<Eigen::Vector2i>& cells, const nav_msgs::MapMetaData& info){
+        pcl::PointCloud<pcl::PointXYZ>::Ptr pc(new pcl::PointCloud<pcl::PointXYZ>);
+        for(const auto& c : cells) pc->points.emplace_back((float)(info.resolution * c.x() + info.origin.position.x),(float)(info.resolution * c.y() + info.origin.position.y),0.0f);
+        pc->width = pc->points.size();
+        pc->height = 1;
+        pc->is_dense = true;
+        return pc;
+    }
+
+    // 同じ大きさのクラスタの順番は決まっていないので, 大きさと最初の点の番号で並べた順番を返す
+    std::vector<int> canonicalOrder(std::vector<pcl::PointIndices>& indices){
+        for(auto&& pi : indices) std::sort(pi.indices.begin(),pi.indices.end());
+        std::vector<int> order(indices.size());
+        for(int i=0,ie=order.size();i!=ie;++i) order[i] = i;
+        std::sort(order.begin(),order.end(),[&indices](int a, int b){
+            const auto& l = indices[a].indices;
+            const auto& r = indices[b].indices;
+            return l.size() != r.size() ? l.size() > r.size() : l.front() < r.front();
+        });
+        return order;
+    }
+
+    // 点の多い順に並んでいて, 大きさの範囲に収まっているか
+    void checkSizes(const std::vector<pcl::PointIndices>& indices, int minSize, int maxSize){
+        for(int i=0,ie=indices.size();i!=ie;++i){
+            EXPECT_GE((int)indices[i].indices.size(), minSize);
+            EXPECT_LE((int)indices[i].indices.size(), maxSize);
+            if(i > 0){
+                EXPECT_GE(indices[i-1].indices.size(), indices[i].indices.size());
+            }
+        }
+    }
+
+    void compare(const grid& g, double tolerance, int minSize, int maxSize, int threads){
+        const std::vector<Eigen::Vector2i> cells(horizonCells(g));
+        ASSERT_FALSE(cells.empty());
+        ExpLib::ThreadPool pool(threads);
+        std::vector<pcl::PointIndices> gridIndices, euclideanIndices;
+        std::vector<HorizonClustering::moment> gridMoments, euclideanMoments;
+        HorizonClustering::grid(cells, g.info, tolerance, minSize, maxSize, pool, gridIndices, gridMoments);
+        HorizonClustering::euclidean(cells, toCloud(cells,g.info), tolerance, minSize, maxSize, euclideanIndices, euclideanMoments);
+
+        ASSERT_EQ(gridIndices.size(), gridMoments.size());
+        ASSERT_EQ(euclideanIndices.size(), euclideanMoments.size());
+        checkSizes(gridIndices,minSize,maxSize);
+        checkSizes(euclideanIndices,minSize,maxSize);
+        ASSERT_EQ(gridIndices.size(), euclideanIndices.size()) << "tolerance : " << tolerance << ", threads : " << threads;
+
+        const std::vector<int> gridOrder(canonicalOrder(gridIndices));
+        const std::vector<int> euclideanOrder(canonicalOrder(euclideanIndices));
+        const double res = g.info.resolution;
+        for(int k=0,ke=gridOrder.size();k!=ke;++k){
+            const int gi = gridOrder[k], ei = euclideanOrder[k];
+            ASSERT_EQ(gridIndices[gi].indices, euclideanIndices[ei].indices) << "cluster " << k << ", tolerance : " << tolerance << ", threads : " << threads;
+            const HorizonClustering::moment& gm = gridMoments[gi];
+            const HorizonClustering::moment& em = euclideanMoments[ei];
+            EXPECT_EQ(gm.count, (int)gridIndices[gi].indices.size());
+            EXPECT_EQ(em.count, (int)euclideanIndices[ei].indices.size());
+            EXPECT_TRUE(gm.centroid(g.info).isApprox(em.centroid(g.info))) << "cluster " << k;
+            EXPECT_TRUE(gm.variance(res).isApprox(em.variance(res))) << "cluster " << k;
+            EXPECT_EQ(gm.bounds, em.bounds) << "cluster " << k;
+            EXPECT_DOUBLE_EQ(gm.area(res), em.area(res)) << "cluster " << k;
+        }
+    }
+
+    // 許容距離がセルの間隔のちょうど整数倍だと float の座標を使う EuclideanClusterExtraction との境界の判定が丸め誤差で揺れるので,
+    // 近傍の形が変わる間隔 (1, 1.41, 2, 2.24, 2.83, 3 セル) の間の値を使う
+    const double TOLERANCES[] = {0.06, 0.08, 0.12, 0.145, 0.17};
+}
+
+TEST(HorizonClustering, MomentStatistics){
+    // 横一列の 3 点 (0,0), (1,0), (2,0)
+    HorizonClustering::moment m;
+    for(int x=0;x<3;++x) m.add(x,0);
+    const nav_msgs::MapMetaData info(mapInfo(10,10));
+    const double res = info.resolution; // float32 なので 0.05 と比べない
+    EXPECT_EQ(m.count, 3);
+    EXPECT_TRUE(m.centroid(info).isApprox(Eigen::Vector2d(-10.0 + res, -10.0)));
+    EXPECT_NEAR(m.variance(res).x(), res * res * 2.0 / 3.0, 1e-12);
+    EXPECT_NEAR(m.variance(res).y(), 0.0, 1e-12);
+    EXPECT_EQ(m.bounds, Eigen::Vector4i(0,0,2,0));
+    EXPECT_DOUBLE_EQ(m.area(res), 0.0);
+}
+
+TEST(HorizonClustering, Rooms){
+    const grid g(fromText(ROOMS));
+    for(const auto& tolerance : TOLERANCES){
+        for(int threads : {1, 4}) compare(g, tolerance, 1, INT_MAX, threads);
+    }
+}
+
+TEST(HorizonClustering, SizeLimits){
+    const grid g(fromText(ROOMS));
+    for(const auto& tolerance : TOLERANCES) compare(g, tolerance, 3, 20, 1);
+}
+
+TEST(HorizonClustering, RandomGrids){
+    for(unsigned seed=0;seed<4;++seed){
+        const grid g(randomGrid(120,90,seed));
+        for(const auto& tolerance : TOLERANCES){
+            for(int threads : {1, 4}) compare(g, tolerance, 2, 400, threads);
+        }
+    }
+}
+
+int main(int argc, char** argv){
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -46,7 +46,9 @@ int main(int argc, char** argv){
             lp_.projectLaser(scan[i],cloud[i]);
             pcl::PointCloud<pcl::PointXYZ>::Ptr tempCloud(new pcl::PointCloud<pcl::PointXYZ>);
             pcl::fromROSMsg(cloud[i],*tempCloud);
-            for(auto&& p : tempCloud->points) ExpLib::Utility::coordinateConverter2d<void>(listener[i],mlf,scan[i].header.frame_id,p);
+            // 変換は点ごとではなくスキャンごとに一度だけ取得する
+            Eigen::Isometry2d transform;
+            if(ExpLib::Utility::lookupTransform2d(listener[i],mlf,scan[i].header.frame_id,transform)) ExpLib::Utility::transformPoints2d(transform,tempCloud->points);
             pcl::toROSMsg(*tempCloud,cloud[i]);
         }
 